@@ -3,33 +3,82 @@
 #include <iomanip>
 #include <mutex>
 #include <algorithm>
+#include <cstring>
 #include <openssl/sha.h>
+#include "SparseFile.h"
 
 namespace {
     std::mutex objectsMutex;
     std::mutex restorePointsMutex;
 
-    std::string calculateFileChecksum(const fs::path& path) {
+    // Блок, которым считается контрольная сумма; границы блоков отсчитываются
+    // от начала файла и не зависят от размещения файла на диске
+    constexpr uint64_t kChecksumBlock = 4096;
+
+    Digest calculateFileChecksum(const fs::path& path) {
         std::ifstream file(path, std::ios::binary);
         if (!file) {
             throw std::runtime_error("Не удалось открыть файл для подсчета контрольной суммы");
         }
 
+        // Хешируются смещения и содержимое ненулевых блоков и размер файла, поэтому
+        // дыра и записанные нули дают одну сумму. Читаются только области данных.
+        ExtentMap map = readExtentMap(path);
+
         SHA256_CTX sha256;
         SHA256_Init(&sha256);
-        char buffer[4096];
-        while (file.read(buffer, sizeof(buffer)).gcount() > 0) {
-            SHA256_Update(&sha256, buffer, file.gcount());
+        static const char zeros[kChecksumBlock] = {};
+        std::vector<char> buffer(256 * kChecksumBlock);
+        uint64_t next = 0; // начало первого еще не хешированного блока
+        for (const auto& extent : map.extents) {
+            uint64_t begin = std::max(extent.offset / kChecksumBlock * kChecksumBlock, next);
+            uint64_t end = std::min(extent.offset + extent.length, map.size);
+            while (begin < end) {
+                file.clear();
+                file.seekg(static_cast<std::streamoff>(begin));
+                auto toRead = std::min<uint64_t>(buffer.size(), end - begin + kChecksumBlock - 1);
+                toRead -= toRead % kChecksumBlock;
+                file.read(buffer.data(), static_cast<std::streamsize>(toRead));
+                auto got = static_cast<uint64_t>(file.gcount());
+                if (got == 0) {
+                    break; // файл укоротился во время чтения
+                }
+                for (uint64_t pos = 0; pos < got; pos += kChecksumBlock) {
+                    size_t length = static_cast<size_t>(std::min(kChecksumBlock, got - pos));
+                    if (std::memcmp(buffer.data() + pos, zeros, length) == 0) {
+                        continue;
+                    }
+                    uint64_t offset = begin + pos;
+                    SHA256_Update(&sha256, &offset, sizeof(offset));
+                    SHA256_Update(&sha256, buffer.data() + pos, length);
+                }
+                begin += (got + kChecksumBlock - 1) / kChecksumBlock * kChecksumBlock;
+            }
+            next = std::max(next, begin);
         }
+        SHA256_Update(&sha256, &map.size, sizeof(map.size));
+
+        static_assert(sizeof(Digest) == SHA256_DIGEST_LENGTH, "Digest должен вмещать SHA-256");
+        Digest digest;
+        SHA256_Final(digest.data(), &sha256);
+        return digest;
+    }
+}
 
-        unsigned char hash[SHA256_DIGEST_LENGTH];
-        SHA256_Final(hash, &sha256);
+void IStorageStrategy::restoreFile(const fs::path& storedPath, const fs::path& targetPath) {
+    try {
+        copySparseFile(storedPath, targetPath);
+    } catch (const std::exception& e) {
+        throw std::runtime_error("Ошибка при восстановлении файла: " + std::string(e.what()));
+    }
+}
 
-        std::stringstream ss;
-        for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-            ss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
+void IStorageStrategy::restoreFiles(const std::vector<CopyRequest>& files, const CopyCallback& onRestored) {
+    for (size_t i = 0; i < files.size(); ++i) {
+        restoreFile(files[i].source, files[i].target);
+        if (onRestored) {
+            onRestored(i);
         }
-        return ss.str();
     }
 }
 
@@ -41,12 +90,28 @@ BackupObject::BackupObject(const fs::path& path) : path_(path) {
         throw std::invalid_argument("Требуется абсолютный путь: " + path_.string());
     }
     storedChecksum_ = calculateChecksum();
+    size_ = fs::file_size(path_);
+}
+
+BackupObject::BackupObject(const fs::path& path, const Digest& digest, uint64_t size)
+    : path_(path), storedChecksum_(digest), size_(size) {
+    if (path_.empty()) {
+        throw std::invalid_argument("Путь не может быть пустым");
+    }
 }
 
 const fs::path& BackupObject::getPath() const {
     return path_;
 }
 
+const Digest& BackupObject::getDigest() const {
+    return storedChecksum_;
+}
+
+uint64_t BackupObject::getSize() const {
+    return size_;
+}
+
 bool BackupObject::exists() const {
     std::error_code ec;
     bool exists = fs::exists(path_, ec);
@@ -56,7 +121,7 @@ bool BackupObject::exists() const {
     return exists;
 }
 
-std::string BackupObject::calculateChecksum() const {
+Digest BackupObject::calculateChecksum() const {
     return calculateFileChecksum(path_);
 }
 
@@ -67,11 +132,15 @@ bool BackupObject::verifyChecksum() const {
     return calculateChecksum() == storedChecksum_;
 }
 
-RestorePoint::RestorePoint(const std::vector<std::shared_ptr<BackupObject>>& objects,
+RestorePoint::RestorePoint(std::shared_ptr<Catalog> catalog,
+                         ObjectList objects,
                          const fs::path& location,
                          std::chrono::system_clock::time_point timestamp)
-    : objects_(objects), location_(location), timestamp_(timestamp) {
-    if (objects_.empty()) {
+    : catalog_(std::move(catalog)), objects_(std::move(objects)), location_(location), timestamp_(timestamp) {
+    if (!catalog_) {
+        throw std::invalid_argument("Каталог не может быть nullptr");
+    }
+    if (!objects_ || objects_->empty()) {
         throw std::invalid_argument("Список объектов не может быть пустым");
     }
     if (location_.empty()) {
@@ -79,7 +148,15 @@ RestorePoint::RestorePoint(const std::vector<std::shared_ptr<BackupObject>>& obj
     }
 }
 
-const std::vector<std::shared_ptr<BackupObject>>& RestorePoint::getObjects() const {
+const Catalog& RestorePoint::getCatalog() const {
+    return *catalog_;
+}
+
+const std::vector<ObjectId>& RestorePoint::getObjects() const {
+    return *objects_;
+}
+
+const RestorePoint::ObjectList& RestorePoint::getObjectList() const {
     return objects_;
 }
 
@@ -92,8 +169,10 @@ std::chrono::system_clock::time_point RestorePoint::getTimestamp() const {
 }
 
 bool RestorePoint::verifyIntegrity() const {
-    for (const auto& obj : objects_) {
-        if (!obj->verifyChecksum()) {
+    for (ObjectId id : *objects_) {
+        fs::path path = catalog_->path(id);
+        std::error_code ec;
+        if (!fs::exists(path, ec) || calculateFileChecksum(path) != catalog_->digest(id)) {
             return false;
         }
     }
@@ -103,13 +182,14 @@ bool RestorePoint::verifyIntegrity() const {
 void RestorePoint::serialize(std::ostream& os) const {
     os << location_.string() << "\n";
     os << std::chrono::system_clock::to_time_t(timestamp_) << "\n";
-    os << objects_.size() << "\n";
-    for (const auto& obj : objects_) {
-        os << obj->getPath().string() << "\n";
+    os << objects_->size() << "\n";
+    for (ObjectId id : *objects_) {
+        os << digestToHex(catalog_->digest(id)) << " " << catalog_->size(id) << " "
+           << catalog_->path(id).string() << "\n";
     }
 }
 
-std::shared_ptr<RestorePoint> RestorePoint::deserialize(std::istream& is) {
+std::shared_ptr<RestorePoint> RestorePoint::deserialize(std::istream& is, std::shared_ptr<Catalog> catalog) {
     std::string locationStr;
     std::getline(is, locationStr);
     
@@ -121,22 +201,37 @@ std::shared_ptr<RestorePoint> RestorePoint::deserialize(std::istream& is) {
     is >> objectCount;
     is.ignore();
 
-    std::vector<std::shared_ptr<BackupObject>> objects;
+    auto objects = std::make_shared<std::vector<ObjectId>>();
+    objects->reserve(objectCount);
     for (size_t i = 0; i < objectCount; ++i) {
-        std::string pathStr;
-        std::getline(is, pathStr);
-        objects.push_back(std::make_shared<BackupObject>(pathStr));
+        std::string line;
+        std::getline(is, line);
+
+        // Строка: "<sha256> <размер> <путь>"; в старом формате - только путь,
+        // тогда контрольная сумма считается по текущему файлу
+        Digest digest;
+        size_t sizeEnd = line.find(' ', 2 * digest.size() + 1);
+        if (line.size() > 2 * digest.size() && line[2 * digest.size()] == ' ' &&
+            sizeEnd != std::string::npos &&
+            digestFromHex(std::string_view(line).substr(0, 2 * digest.size()), digest)) {
+            uint64_t size = std::stoull(line.substr(2 * digest.size() + 1, sizeEnd - 2 * digest.size() - 1));
+            objects->push_back(catalog->add(line.substr(sizeEnd + 1), digest, size));
+        } else {
+            BackupObject object(line);
+            objects->push_back(catalog->add(object.getPath(), object.getDigest(), object.getSize()));
+        }
     }
 
     return std::make_shared<RestorePoint>(
-        objects,
+        std::move(catalog),
+        std::move(objects),
         fs::path(locationStr),
         std::chrono::system_clock::from_time_t(timeT)
     );
 }
 
 BackupJob::BackupJob(std::unique_ptr<IStorageStrategy> strategy, const fs::path& backupDir)
-    : backupDirectory_(backupDir) {
+    : catalog_(std::make_shared<Catalog>()), backupDirectory_(backupDir), operationCancelled_(false) {
     if (!strategy) {
         throw std::invalid_argument("Стратегия хранения не может быть nullptr");
     }
@@ -158,24 +253,30 @@ void BackupJob::addObject(const fs::path& path) {
         throw std::runtime_error("Путь не существует: " + path.string());
     }
 
-    auto newObject = std::make_shared<BackupObject>(path);
+    BackupObject newObject(path);
     
     std::lock_guard<std::mutex> lock(objectsMutex);
-    auto it = std::find_if(objects_.begin(), objects_.end(),
-                          [&path](const auto& obj) { return obj->getPath() == path; });
-    if (it != objects_.end()) {
-        throw std::runtime_error("Объект уже существует: " + path.string());
+    PathId pathId = 0;
+    if (catalog_->findPath(newObject.getPath(), pathId)) {
+        auto it = std::find_if(objects_.begin(), objects_.end(),
+                              [&](ObjectId id) { return catalog_->pathId(id) == pathId; });
+        if (it != objects_.end()) {
+            throw std::runtime_error("Объект уже существует: " + path.string());
+        }
     }
-    objects_.push_back(std::move(newObject));
+    objects_.push_back(catalog_->add(newObject.getPath(), newObject.getDigest(), newObject.getSize()));
 }
 
 void BackupJob::removeObject(const fs::path& path) {
     std::lock_guard<std::mutex> lock(objectsMutex);
+    PathId pathId = 0;
     auto initialSize = objects_.size();
-    objects_.erase(
-        std::remove_if(objects_.begin(), objects_.end(),
-                      [&path](const auto& obj) { return obj->getPath() == path; }),
-        objects_.end());
+    if (catalog_->findPath(path, pathId)) {
+        objects_.erase(
+            std::remove_if(objects_.begin(), objects_.end(),
+                          [&](ObjectId id) { return catalog_->pathId(id) == pathId; }),
+            objects_.end());
+    }
     
     if (objects_.size() == initialSize) {
         throw std::runtime_error("Объект не найден: " + path.string());
@@ -183,15 +284,69 @@ void BackupJob::removeObject(const fs::path& path) {
 }
 
 std::shared_ptr<RestorePoint> BackupJob::createRestorePoint() {
+    // Стратегиям хранения нужны объекты; собираем их из каталога на время сохранения
     std::vector<std::shared_ptr<BackupObject>> objectsCopy;
     {
         std::lock_guard<std::mutex> lock(objectsMutex);
         if (objects_.empty()) {
             throw std::runtime_error("Нет объектов для создания точки восстановления");
         }
-        objectsCopy = objects_; // Создаем копию для безопасной работы
+        objectsCopy.reserve(objects_.size());
+        for (ObjectId id : objects_) {
+            objectsCopy.push_back(std::make_shared<BackupObject>(
+                catalog_->path(id), catalog_->digest(id), catalog_->size(id)));
+        }
+    }
+
+    return storeRestorePoint(objectsCopy);
+}
+
+std::shared_ptr<RestorePoint> BackupJob::createRestorePoint(const std::vector<fs::path>& changedPaths) {
+    if (changedPaths.empty()) {
+        throw std::runtime_error("Нет измененных объектов для создания точки восстановления");
+    }
+
+    // Контрольные суммы считаем вне блокировки
+    std::vector<std::shared_ptr<BackupObject>> changedObjects;
+    changedObjects.reserve(changedPaths.size());
+    for (const auto& path : changedPaths) {
+        changedObjects.push_back(std::make_shared<BackupObject>(path));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(objectsMutex);
+        for (const auto& changed : changedObjects) {
+            PathId pathId = 0;
+            if (!catalog_->findPath(changed->getPath(), pathId) ||
+                std::none_of(objects_.begin(), objects_.end(),
+                             [&](ObjectId id) { return catalog_->pathId(id) == pathId; })) {
+                throw std::runtime_error("Объект не зарегистрирован: " + changed->getPath().string());
+            }
+        }
+    }
+
+    auto restorePoint = storeRestorePoint(changedObjects);
+
+    // Новые версии объектов принимаем только после успешного сохранения;
+    // объекты, удаленные за это время, не возвращаем. Если каталог заменен
+    // загрузкой состояния, идентификаторы точки к нему не относятся.
+    std::lock_guard<std::mutex> lock(objectsMutex);
+    const Catalog& catalog = restorePoint->getCatalog();
+    if (&catalog != catalog_.get()) {
+        return restorePoint;
+    }
+    for (ObjectId changed : restorePoint->getObjects()) {
+        PathId pathId = catalog.pathId(changed);
+        auto it = std::find_if(objects_.begin(), objects_.end(),
+                              [&](ObjectId id) { return catalog.pathId(id) == pathId; });
+        if (it != objects_.end()) {
+            *it = changed;
+        }
     }
+    return restorePoint;
+}
 
+std::shared_ptr<RestorePoint> BackupJob::storeRestorePoint(const std::vector<std::shared_ptr<BackupObject>>& objectsCopy) {
     // Проверяем существование всех файлов перед созданием точки восстановления
     for (const auto& obj : objectsCopy) {
         if (!obj->exists()) {
@@ -213,27 +368,54 @@ std::shared_ptr<RestorePoint> BackupJob::createRestorePoint() {
 
     try {
         storageStrategy_->store(objectsCopy, restorePointPath);
+        if (parityOptions_.enabled()) {
+            ParityProtector(parityOptions_).protect(restorePointPath);
+        }
     } catch (const std::exception& e) {
         // В случае ошибки, пытаемся удалить созданную директорию
         fs::remove_all(restorePointPath, ec);
         throw std::runtime_error("Ошибка при сохранении точки восстановления: " + std::string(e.what()));
     }
 
-    auto restorePoint = std::make_shared<RestorePoint>(objectsCopy, restorePointPath, timestamp);
-    
+    // loadState может заменить каталог, поэтому указатель берем под блокировкой
+    std::shared_ptr<Catalog> catalog;
     {
         std::lock_guard<std::mutex> lock(restorePointsMutex);
+        catalog = catalog_;
+    }
+    auto objectIds = std::make_shared<std::vector<ObjectId>>();
+    objectIds->reserve(objectsCopy.size());
+    for (const auto& obj : objectsCopy) {
+        objectIds->push_back(catalog->add(obj->getPath(), obj->getDigest(), obj->getSize()));
+    }
+
+    std::shared_ptr<RestorePoint> restorePoint;
+    {
+        std::lock_guard<std::mutex> lock(restorePointsMutex);
+        // Если набор объектов не изменился, разделяем список с предыдущей точкой
+        RestorePoint::ObjectList objectList = std::move(objectIds);
+        if (!restorePoints_.empty() && &restorePoints_.back()->getCatalog() == catalog.get() &&
+            restorePoints_.back()->getObjects() == *objectList) {
+            objectList = restorePoints_.back()->getObjectList();
+        }
+        restorePoint = std::make_shared<RestorePoint>(std::move(catalog), std::move(objectList),
+                                                      restorePointPath, timestamp);
         restorePoints_.push_back(restorePoint);
     }
 
     return restorePoint;
 }
 
-const std::vector<std::shared_ptr<BackupObject>>& BackupJob::getObjects() const {
+const std::vector<ObjectId>& BackupJob::getObjects() const {
     std::lock_guard<std::mutex> lock(objectsMutex);
     return objects_;
 }
 
+const Catalog& BackupJob::getCatalog() const {
+    std::lock_guard<std::mutex> lock(objectsMutex);
+    return *catalog_;
+}
+
 const std::vector<std::shared_ptr<RestorePoint>>& BackupJob::getRestorePoints() const {
     std::lock_guard<std::mutex> lock(restorePointsMutex);
     return restorePoints_;
@@ -256,27 +438,25 @@ void BackupJob::restore(const RestorePoint& point, const fs::path& targetDir) {
         }
     }
 
+    const auto& catalog = point.getCatalog();
     const auto& objects = point.getObjects();
-    float progressStep = 1.0f / objects.size();
-    float currentProgress = 0.0f;
+    std::vector<CopyRequest> files;
+    files.reserve(objects.size());
+    for (ObjectId id : objects) {
+        std::string filename = catalog.filename(id);
+        files.push_back({point.getLocation() / filename, targetDir / filename});
+    }
 
-    for (const auto& obj : objects) {
+    // Файлы восстанавливаются пакетом, прогресс сообщается по мере завершения
+    float progressStep = 1.0f / files.size();
+    float currentProgress = 0.0f;
+    storageStrategy_->restoreFiles(files, [&](size_t index) {
         if (operationCancelled_) {
             throw std::runtime_error("Операция отменена пользователем");
         }
-
-        fs::path sourcePath = point.getLocation() / obj->getPath().filename();
-        fs::path targetPath = targetDir / obj->getPath().filename();
-
-        reportProgress(currentProgress, "Восстановление: " + obj->getPath().filename().string());
-
-        fs::copy_file(sourcePath, targetPath, fs::copy_options::overwrite_existing, ec);
-        if (ec) {
-            throw std::runtime_error("Ошибка при восстановлении файла: " + ec.message());
-        }
-
         currentProgress += progressStep;
-    }
+        reportProgress(currentProgress, "Восстановлено: " + files[index].target.filename().string());
+    });
 
     reportProgress(1.0f, "Восстановление завершено");
 }
@@ -291,8 +471,8 @@ void BackupJob::saveState(const fs::path& statePath) const {
     std::lock_guard<std::mutex> lockPoints(restorePointsMutex);
 
     file << objects_.size() << "\n";
-    for (const auto& obj : objects_) {
-        file << obj->getPath().string() << "\n";
+    for (ObjectId id : objects_) {
+        file << catalog_->path(id).string() << "\n";
     }
 
     file << restorePoints_.size() << "\n";
@@ -312,6 +492,7 @@ void BackupJob::loadState(const fs::path& statePath) {
 
     objects_.clear();
     restorePoints_.clear();
+    catalog_ = std::make_shared<Catalog>();
 
     size_t objectCount;
     file >> objectCount;
@@ -320,7 +501,8 @@ void BackupJob::loadState(const fs::path& statePath) {
     for (size_t i = 0; i < objectCount; ++i) {
         std::string pathStr;
         std::getline(file, pathStr);
-        objects_.push_back(std::make_shared<BackupObject>(pathStr));
+        BackupObject object(pathStr);
+        objects_.push_back(catalog_->add(object.getPath(), object.getDigest(), object.getSize()));
     }
 
     size_t pointCount;
@@ -328,7 +510,7 @@ void BackupJob::loadState(const fs::path& statePath) {
     file.ignore();
 
     for (size_t i = 0; i < pointCount; ++i) {
-        restorePoints_.push_back(RestorePoint::deserialize(file));
+        restorePoints_.push_back(RestorePoint::deserialize(file, catalog_));
     }
 }
 
@@ -336,6 +518,17 @@ bool BackupJob::verifyBackup(const RestorePoint& point) const {
     return point.verifyIntegrity();
 }
 
+ScrubReport BackupJob::scrub(const RestorePoint& point) const {
+    return ParityProtector::scrub(point.getLocation());
+}
+
+void BackupJob::setParityOptions(const ParityOptions& options) {
+    if (options.enabled()) {
+        ParityProtector validate(options); // бросает исключение при неверных параметрах
+    }
+    parityOptions_ = options;
+}
+
 void BackupJob::setProgressCallback(ProgressCallback callback) {
     progressCallback_ = std::move(callback);
 }
@@ -8,6 +8,9 @@
 #include <stdexcept>
 #include <fstream>
 #include <functional>
+#include "ParityStorage.h"
+#include "Catalog.h"
+#include "IoEngine.h"
 
 namespace fs = std::filesystem;
 
@@ -25,40 +28,58 @@ public:
     virtual ~IStorageStrategy() = default;
     virtual void store(const std::vector<std::shared_ptr<BackupObject>>& objects, 
                       const fs::path& destination) = 0;
+    // Восстановление одного сохраненного файла; по умолчанию - простое копирование
+    virtual void restoreFile(const fs::path& storedPath, const fs::path& targetPath);
+    // Пакетное восстановление (source - сохраненный файл, target - куда восстановить);
+    // по умолчанию restoreFile вызывается для каждого файла по очереди
+    virtual void restoreFiles(const std::vector<CopyRequest>& files, const CopyCallback& onRestored);
 };
 
 // Backup object representing a file or data to be backed up
 class BackupObject {
 public:
     explicit BackupObject(const fs::path& path);
+    // Объект с уже известной контрольной суммой (из каталога), файл не читается
+    BackupObject(const fs::path& path, const Digest& digest, uint64_t size);
     const fs::path& getPath() const;
+    const Digest& getDigest() const;
+    uint64_t getSize() const;
     bool exists() const;
     bool verifyChecksum() const;
 
 private:
     fs::path path_;
-    std::string calculateChecksum() const;
-    std::string storedChecksum_;
+    Digest calculateChecksum() const;
+    Digest storedChecksum_;
+    uint64_t size_;
 };
 
-// Restore point representing a snapshot of backed up objects
+// Restore point representing a snapshot of backed up objects.
+// Объекты хранятся в общем каталоге, точка держит только их идентификаторы;
+// одинаковые списки идентификаторов разделяются между точками.
 class RestorePoint {
 public:
-    RestorePoint(const std::vector<std::shared_ptr<BackupObject>>& objects,
+    using ObjectList = std::shared_ptr<const std::vector<ObjectId>>;
+
+    RestorePoint(std::shared_ptr<Catalog> catalog,
+                ObjectList objects,
                 const fs::path& location,
                 std::chrono::system_clock::time_point timestamp);
 
-    const std::vector<std::shared_ptr<BackupObject>>& getObjects() const;
+    const Catalog& getCatalog() const;
+    const std::vector<ObjectId>& getObjects() const;
+    const ObjectList& getObjectList() const;
     const fs::path& getLocation() const;
     std::chrono::system_clock::time_point getTimestamp() const;
     bool verifyIntegrity() const;
 
     // Сериализация
     void serialize(std::ostream& os) const;
-    static std::shared_ptr<RestorePoint> deserialize(std::istream& is);
+    static std::shared_ptr<RestorePoint> deserialize(std::istream& is, std::shared_ptr<Catalog> catalog);
 
 private:
-    std::vector<std::shared_ptr<BackupObject>> objects_;
+    std::shared_ptr<Catalog> catalog_;
+    ObjectList objects_;
     fs::path location_;
     std::chrono::system_clock::time_point timestamp_;
 };
@@ -71,25 +92,36 @@ public:
     void addObject(const fs::path& path);
     void removeObject(const fs::path& path);
     std::shared_ptr<RestorePoint> createRestorePoint();
+    // Точка восстановления только из измененных файлов: пересчитываются
+    // контрольные суммы лишь этих объектов
+    std::shared_ptr<RestorePoint> createRestorePoint(const std::vector<fs::path>& changedPaths);
     
     // Новые методы
     void restore(const RestorePoint& point, const fs::path& targetDir);
     void saveState(const fs::path& statePath) const;
     void loadState(const fs::path& statePath);
     bool verifyBackup(const RestorePoint& point) const;
+    // Проверка сохраненных данных (а не исходных файлов) с восстановлением по четности
+    ScrubReport scrub(const RestorePoint& point) const;
+    void setParityOptions(const ParityOptions& options);
     void setProgressCallback(ProgressCallback callback);
     void cancelOperation(); // Для отмены текущей операции
 
-    const std::vector<std::shared_ptr<BackupObject>>& getObjects() const;
+    // Зарегистрированные объекты - идентификаторы в каталоге getCatalog()
+    const std::vector<ObjectId>& getObjects() const;
+    const Catalog& getCatalog() const;
     const std::vector<std::shared_ptr<RestorePoint>>& getRestorePoints() const;
 
 private:
-    std::vector<std::shared_ptr<BackupObject>> objects_;
+    std::vector<ObjectId> objects_; // последняя сохраненная версия каждого файла
     std::vector<std::shared_ptr<RestorePoint>> restorePoints_;
+    std::shared_ptr<Catalog> catalog_;
     std::unique_ptr<IStorageStrategy> storageStrategy_;
     fs::path backupDirectory_;
     ProgressCallback progressCallback_;
     bool operationCancelled_;
+    ParityOptions parityOptions_;
     
     void reportProgress(float progress, const std::string& message);
+    std::shared_ptr<RestorePoint> storeRestorePoint(const std::vector<std::shared_ptr<BackupObject>>& objects);
 }; 
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "Catalog.h"
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    uint32_t hashBytes(const void* data, size_t size, uint32_t seed) {
+        // FNV-1a
+        uint32_t hash = 2166136261u ^ seed;
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+}
+
+void IdHashIndex::insert(uint32_t hash, uint32_t id) {
+    // Поддерживаем заполненность не выше 3/4
+    if ((count_ + 1) * 4 > slots_.size() * 3) {
+        std::vector<Slot> old = std::move(slots_);
+        slots_.assign(old.empty() ? 16 : old.size() * 2, Slot{0, kEmpty});
+        for (const auto& slot : old) {
+            if (slot.id != kEmpty) {
+                place(slot);
+            }
+        }
+    }
+    place(Slot{hash, id});
+    ++count_;
+}
+
+void IdHashIndex::place(Slot slot) {
+    const size_t mask = slots_.size() - 1;
+    size_t i = slot.hash & mask;
+    while (slots_[i].id != kEmpty) {
+        i = (i + 1) & mask;
+    }
+    slots_[i] = slot;
+}
+
+PathStore::PathStore() {
+    nodes_.push_back(Node{0, 0, 0});
+}
+
+uint32_t PathStore::childHash(PathId parent, std::string_view name) const {
+    return hashBytes(name.data(), name.size(), parent * 0x9E3779B9u);
+}
+
+bool PathStore::findChild(PathId parent, std::string_view name, uint32_t hash, PathId& id) const {
+    auto equals = [&](uint32_t candidate) {
+        return nodes_[candidate].parent == parent && this->name(nodes_[candidate]) == name;
+    };
+    return index_.find(hash, equals, id);
+}
+
+PathId PathStore::child(PathId parent, std::string_view name) {
+    uint32_t hash = childHash(parent, name);
+    PathId id = 0;
+    if (findChild(parent, name, hash, id)) {
+        return id;
+    }
+
+    if (nodes_.size() >= UINT32_MAX || arena_.size() + name.size() > UINT32_MAX) {
+        throw std::length_error("Переполнение хранилища путей");
+    }
+    id = static_cast<PathId>(nodes_.size());
+    nodes_.push_back(Node{parent, static_cast<uint32_t>(arena_.size()), static_cast<uint32_t>(name.size())});
+    arena_.append(name.data(), name.size());
+    index_.insert(hash, id);
+    return id;
+}
+
+PathId PathStore::intern(const fs::path& path) {
+    PathId id = 0;
+    for (const auto& component : path) {
+        id = child(id, component.native());
+    }
+    return id;
+}
+
+bool PathStore::find(const fs::path& path, PathId& id) const {
+    id = 0;
+    for (const auto& component : path) {
+        const auto& name = component.native();
+        if (!findChild(id, name, childHash(id, name), id)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+fs::path PathStore::path(PathId id) const {
+    std::vector<PathId> chain;
+    for (; id != 0; id = nodes_[id].parent) {
+        chain.push_back(id);
+    }
+    fs::path result;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        result /= fs::path(std::string(name(nodes_[*it])));
+    }
+    return result;
+}
+
+std::string PathStore::filename(PathId id) const {
+    return std::string(name(nodes_[id]));
+}
+
+ObjectId Catalog::add(const fs::path& path, const Digest& digest, uint64_t size) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    PathId pathId = paths_.intern(path);
+    uint32_t hash = hashBytes(digest.data(), digest.size(), pathId);
+
+    ObjectId id = 0;
+    auto equals = [&](uint32_t candidate) {
+        return objectPaths_[candidate] == pathId && digests_[candidate] == digest;
+    };
+    if (objectIndex_.find(hash, equals, id)) {
+        return id;
+    }
+
+    id = static_cast<ObjectId>(objectPaths_.size());
+    objectPaths_.push_back(pathId);
+    digests_.push_back(digest);
+    sizes_.push_back(size);
+    objectIndex_.insert(hash, id);
+    return id;
+}
+
+PathId Catalog::pathId(ObjectId id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return objectPaths_.at(id);
+}
+
+bool Catalog::findPath(const fs::path& path, PathId& id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return paths_.find(path, id);
+}
+
+fs::path Catalog::path(ObjectId id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return paths_.path(objectPaths_.at(id));
+}
+
+std::string Catalog::filename(ObjectId id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return paths_.filename(objectPaths_.at(id));
+}
+
+Digest Catalog::digest(ObjectId id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return digests_.at(id);
+}
+
+uint64_t Catalog::size(ObjectId id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return sizes_.at(id);
+}
+
+std::string digestToHex(const Digest& digest) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string hex(digest.size() * 2, '0');
+    for (size_t i = 0; i < digest.size(); ++i) {
+        hex[2 * i] = kHex[digest[i] >> 4];
+        hex[2 * i + 1] = kHex[digest[i] & 0x0F];
+    }
+    return hex;
+}
+
+bool digestFromHex(std::string_view hex, Digest& digest) {
+    if (hex.size() != digest.size() * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < digest.size(); ++i) {
+        int hi = hexValue(hex[2 * i]);
+        int lo = hexValue(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        digest[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return true;
+}
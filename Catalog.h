@@ -0,0 +1,107 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using Digest = std::array<uint8_t, 32>;
+using PathId = uint32_t;
+using ObjectId = uint32_t;
+
+// Хеш-индекс с открытой адресацией: хранит только 32-битные идентификаторы,
+// сами ключи лежат в таблицах владельца, поэтому на запись нет отдельных аллокаций
+class IdHashIndex {
+public:
+    template <typename Equals>
+    bool find(uint32_t hash, Equals equals, uint32_t& id) const {
+        if (slots_.empty()) {
+            return false;
+        }
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask; slots_[i].id != kEmpty; i = (i + 1) & mask) {
+            if (slots_[i].hash == hash && equals(slots_[i].id)) {
+                id = slots_[i].id;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insert(uint32_t hash, uint32_t id);
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t id;
+    };
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    std::vector<Slot> slots_;
+    size_t count_ = 0;
+
+    void place(Slot slot);
+};
+
+// Интернированные пути: префиксное дерево компонентов пути, имена компонентов
+// хранятся один раз в общем буфере. Узел дерева занимает 12 байт.
+class PathStore {
+public:
+    PathStore();
+
+    PathId intern(const fs::path& path);
+    // Ищет путь, не добавляя его
+    bool find(const fs::path& path, PathId& id) const;
+    fs::path path(PathId id) const;
+    std::string filename(PathId id) const;
+
+private:
+    struct Node {
+        PathId parent;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    std::vector<Node> nodes_; // узел 0 - пустой корень
+    std::string arena_;
+    IdHashIndex index_;
+
+    std::string_view name(const Node& node) const {
+        return std::string_view(arena_.data() + node.nameOffset, node.nameLength);
+    }
+    uint32_t childHash(PathId parent, std::string_view name) const;
+    bool findChild(PathId parent, std::string_view name, uint32_t hash, PathId& id) const;
+    PathId child(PathId parent, std::string_view name);
+};
+
+// Каталог объектов всех точек восстановления в виде структуры массивов.
+// Одинаковые объекты (путь + контрольная сумма) хранятся один раз, точки
+// восстановления ссылаются на них 32-битными идентификаторами.
+class Catalog {
+public:
+    ObjectId add(const fs::path& path, const Digest& digest, uint64_t size);
+
+    // Идентификатор пути объекта; у версий одного файла он общий
+    PathId pathId(ObjectId id) const;
+    bool findPath(const fs::path& path, PathId& id) const;
+
+    fs::path path(ObjectId id) const;
+    std::string filename(ObjectId id) const;
+    Digest digest(ObjectId id) const;
+    uint64_t size(ObjectId id) const;
+
+private:
+    mutable std::shared_mutex mutex_;
+    PathStore paths_;
+    std::vector<PathId> objectPaths_;
+    std::vector<Digest> digests_;
+    std::vector<uint64_t> sizes_;
+    IdHashIndex objectIndex_;
+};
+
+std::string digestToHex(const Digest& digest);
+bool digestFromHex(std::string_view hex, Digest& digest);
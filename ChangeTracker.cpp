@@ -0,0 +1,117 @@
+#include "ChangeTracker.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+    constexpr uint32_t kWatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE |
+                                    IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+}
+
+ChangeTracker::ChangeTracker() : fd_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+    if (fd_ < 0) {
+        throw std::runtime_error("Не удалось инициализировать inotify: " + std::string(std::strerror(errno)));
+    }
+}
+
+ChangeTracker::~ChangeTracker() {
+    close(fd_);
+}
+
+void ChangeTracker::watch(const fs::path& path) {
+    fs::path directory = path.parent_path();
+    int wd = inotify_add_watch(fd_, directory.c_str(), kWatchMask);
+    if (wd < 0) {
+        throw std::runtime_error("Не удалось начать наблюдение за " + directory.string() +
+                                 ": " + std::strerror(errno));
+    }
+    // Для уже наблюдаемой директории inotify вернет тот же дескриптор
+    directories_[wd] = directory;
+    watched_.insert(path);
+}
+
+void ChangeTracker::poll(std::chrono::milliseconds timeout) {
+    // poll принимает int миллисекунд; более длинное ожидание режем, вызывающий
+    // все равно повторит poll до своего срока
+    auto milliseconds = std::clamp<std::chrono::milliseconds::rep>(
+        timeout.count(), 0, std::numeric_limits<int>::max());
+    pollfd pfd{fd_, POLLIN, 0};
+    int rc = ::poll(&pfd, 1, static_cast<int>(milliseconds));
+    if (rc < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+        throw std::runtime_error("Ошибка ожидания событий inotify: " + std::string(std::strerror(errno)));
+    }
+    if (rc > 0) {
+        readEvents();
+    }
+}
+
+void ChangeTracker::readEvents() {
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t len = read(fd_, buffer, sizeof(buffer));
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return;
+            }
+            throw std::runtime_error("Ошибка чтения событий inotify: " + std::string(std::strerror(errno)));
+        }
+
+        for (char* ptr = buffer; ptr < buffer + len;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // События потеряны - считаем измененными все файлы
+                dirty_.insert(watched_.begin(), watched_.end());
+                continue;
+            }
+            auto dir = directories_.find(event->wd);
+            if (dir == directories_.end() || event->len == 0) {
+                continue;
+            }
+            fs::path changed = dir->second / event->name;
+            if (watched_.count(changed)) {
+                dirty_.insert(std::move(changed));
+            }
+        }
+    }
+}
+
+#else
+
+ChangeTracker::ChangeTracker() : fd_(-1) {
+    throw std::runtime_error("Отслеживание изменений поддерживается только в Linux");
+}
+
+ChangeTracker::~ChangeTracker() = default;
+
+void ChangeTracker::watch(const fs::path&) {}
+
+void ChangeTracker::poll(std::chrono::milliseconds) {}
+
+void ChangeTracker::readEvents() {}
+
+#endif
+
+bool ChangeTracker::hasChanges() const {
+    return !dirty_.empty();
+}
+
+std::vector<fs::path> ChangeTracker::takeChanges() {
+    std::vector<fs::path> changes(dirty_.begin(), dirty_.end());
+    dirty_.clear();
+    return changes;
+}
+
+void ChangeTracker::markChanged(const std::vector<fs::path>& paths) {
+    dirty_.insert(paths.begin(), paths.end());
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "BackupSystem.h"
+#include <set>
+#include <map>
+#include <chrono>
+
+// Отслеживание изменений зарегистрированных файлов через inotify (только Linux).
+// Наблюдение ведется за родительскими директориями, чтобы не терять файлы,
+// которые редакторы сохраняют через переименование временного файла.
+class ChangeTracker {
+public:
+    ChangeTracker();
+    ~ChangeTracker();
+
+    ChangeTracker(const ChangeTracker&) = delete;
+    ChangeTracker& operator=(const ChangeTracker&) = delete;
+
+    void watch(const fs::path& path);
+
+    // Ждет события не дольше timeout и пополняет набор измененных файлов
+    void poll(std::chrono::milliseconds timeout);
+
+    bool hasChanges() const;
+    // Возвращает измененные файлы и очищает набор
+    std::vector<fs::path> takeChanges();
+    // Возвращает файлы в набор измененных, например если их сохранение не удалось
+    void markChanged(const std::vector<fs::path>& paths);
+
+private:
+    int fd_;
+    std::map<int, fs::path> directories_; // дескриптор наблюдения -> директория
+    std::set<fs::path> watched_;
+    std::set<fs::path> dirty_;
+
+    void readEvents();
+};
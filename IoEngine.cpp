@@ -0,0 +1,551 @@
+#include "IoEngine.h"
+#include "SparseFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Файлы крупнее копируются синхронно через copy_file_range: для них
+    // число системных вызовов уже не главное
+    constexpr uint64_t kSmallFileLimit = 128 * 1024;
+
+    void copySynchronously(const CopyRequest& request) {
+        if (fs::is_directory(request.source)) {
+            fs::copy(request.source, request.target,
+                     fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+        } else {
+            copySparseFile(request.source, request.target);
+        }
+    }
+
+    class SyncIoEngine : public IoEngine {
+    public:
+        void copyFiles(const std::vector<CopyRequest>& requests, const CopyCallback& onCopied) override {
+            for (size_t i = 0; i < requests.size(); ++i) {
+                copySynchronously(requests[i]);
+                if (onCopied) {
+                    onCopied(i);
+                }
+            }
+        }
+    };
+
+#ifdef __linux__
+    std::string errorText(int error) {
+        return std::strerror(error);
+    }
+
+    // Минимальная обертка над кольцами io_uring без liburing
+    class Ring {
+    public:
+        explicit Ring(unsigned entries) {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd_ < 0) {
+                throw std::runtime_error("io_uring недоступен: " + errorText(errno));
+            }
+
+            sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            singleMmap_ = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (singleMmap_) {
+                sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+            }
+
+            try {
+                sqRing_ = mapRegion(sqRingSize_, IORING_OFF_SQ_RING);
+                cqRing_ = singleMmap_ ? sqRing_ : mapRegion(cqRingSize_, IORING_OFF_CQ_RING);
+                sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+                sqes_ = static_cast<io_uring_sqe*>(mapRegion(sqesSize_, IORING_OFF_SQES));
+            } catch (...) {
+                release();
+                throw;
+            }
+
+            auto* sq = static_cast<char*>(sqRing_);
+            sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqEntries_ = params.sq_entries;
+            auto* sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            for (unsigned i = 0; i < sqEntries_; ++i) {
+                sqArray[i] = i;
+            }
+
+            auto* cq = static_cast<char*>(cqRing_);
+            cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        ~Ring() {
+            release();
+        }
+
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+
+        bool supports(std::initializer_list<unsigned> opcodes) const {
+            constexpr unsigned kProbeOps = 256;
+            std::vector<char> storage(sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op), 0);
+            auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+            if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) {
+                return false;
+            }
+            for (unsigned op : opcodes) {
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        unsigned capacity() const { return sqEntries_; }
+
+        // Следующий свободный SQE; заполняется вызывающим
+        io_uring_sqe* nextSqe() {
+            unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+            if (localTail_ - head >= sqEntries_) {
+                return nullptr;
+            }
+            io_uring_sqe* sqe = &sqes_[localTail_ & sqMask_];
+            std::memset(sqe, 0, sizeof(*sqe));
+            ++localTail_;
+            return sqe;
+        }
+
+        // Отправляет подготовленные SQE и ждет хотя бы waitFor завершений.
+        // При временной нехватке ресурсов (EAGAIN) или переполнении очереди
+        // завершений (EBUSY) возвращается без ожидания: вызывающий разбирает
+        // завершения и повторяет отправку.
+        void submit(unsigned waitFor) {
+            __atomic_store_n(sqTail_, localTail_, __ATOMIC_RELEASE);
+            unsigned toSubmit = localTail_ - submitted_;
+            while (true) {
+                long rc = syscall(__NR_io_uring_enter, fd_, toSubmit, waitFor,
+                                  waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+                if (rc >= 0) {
+                    submitted_ += static_cast<unsigned>(rc);
+                    return;
+                }
+                if (errno == EAGAIN) {
+                    sched_yield();
+                    return;
+                }
+                if (errno == EBUSY) {
+                    return;
+                }
+                if (errno != EINTR) {
+                    throw std::runtime_error("Ошибка io_uring_enter: " + errorText(errno));
+                }
+            }
+        }
+
+        // Голова очереди сдвигается до вызова обработчика, поэтому исключение
+        // из него не оставляет кольцо в несогласованном состоянии
+        template <typename Handler>
+        unsigned reap(Handler handler) {
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            unsigned count = 0;
+            for (; head != tail; ++count) {
+                const io_uring_cqe& cqe = cqes_[head & cqMask_];
+                uint64_t userData = cqe.user_data;
+                int result = cqe.res;
+                __atomic_store_n(cqHead_, ++head, __ATOMIC_RELEASE);
+                handler(userData, result);
+            }
+            return count;
+        }
+
+    private:
+        int fd_ = -1;
+        bool singleMmap_ = false;
+        size_t sqRingSize_ = 0;
+        size_t cqRingSize_ = 0;
+        size_t sqesSize_ = 0;
+        void* sqRing_ = nullptr;
+        void* cqRing_ = nullptr;
+        io_uring_sqe* sqes_ = nullptr;
+
+        unsigned* sqHead_ = nullptr;
+        unsigned* sqTail_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned sqEntries_ = 0;
+        unsigned localTail_ = 0;
+        unsigned submitted_ = 0;
+
+        unsigned* cqHead_ = nullptr;
+        unsigned* cqTail_ = nullptr;
+        unsigned cqMask_ = 0;
+        io_uring_cqe* cqes_ = nullptr;
+
+        void release() {
+            if (sqes_) {
+                munmap(sqes_, sqesSize_);
+            }
+            if (cqRing_ && !singleMmap_) {
+                munmap(cqRing_, cqRingSize_);
+            }
+            if (sqRing_) {
+                munmap(sqRing_, sqRingSize_);
+            }
+            close(fd_);
+        }
+
+        void* mapRegion(size_t size, off_t offset) {
+            void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+            if (region == MAP_FAILED) {
+                throw std::runtime_error("Не удалось отобразить кольцо io_uring: " + errorText(errno));
+            }
+            return region;
+        }
+    };
+
+    // Каждый файл проходит этапы: statx -> открытие источника -> открытие
+    // приемника -> чтение -> запись -> закрытие обоих. Приемник открывается
+    // (и усекается) только после успешного открытия источника. Операции разных файлов идут параллельно.
+    class UringIoEngine : public IoEngine {
+    public:
+        explicit UringIoEngine(unsigned queueDepth) : ring_(std::make_unique<Ring>(queueDepth)) {
+            if (!ring_->supports({IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ,
+                                 IORING_OP_WRITE, IORING_OP_CLOSE})) {
+                throw std::runtime_error("Ядро не поддерживает нужные операции io_uring");
+            }
+            // У файла в полете не более двух операций одновременно, поэтому
+            // очередь отправки никогда не переполняется
+            slots_.resize(ring_->capacity() / 2);
+        }
+
+        void copyFiles(const std::vector<CopyRequest>& requests, const CopyCallback& onCopied) override;
+
+    private:
+        enum class Stage { Idle, Stat, Open, Read, Write, Close };
+        enum Operation : uint64_t { OpStat, OpOpenSource, OpOpenTarget, OpRead, OpWrite, OpCloseSource, OpCloseTarget };
+
+        struct Slot {
+            Stage stage = Stage::Idle;
+            size_t request = 0;
+            unsigned pending = 0;
+            int error = 0;
+            bool deferred = false; // будет скопирован синхронно после пакета
+            int sourceFd = -1;
+            int targetFd = -1;
+            struct statx stat;
+            std::vector<char> buffer;
+            uint64_t done = 0;
+        };
+
+        std::unique_ptr<Ring> ring_;
+        std::vector<Slot> slots_;
+        const std::vector<CopyRequest>* requests_ = nullptr;
+        std::vector<size_t> largeFiles_;
+
+        io_uring_sqe* prepare(size_t slot, Operation op) {
+            io_uring_sqe* sqe = ring_->nextSqe();
+            if (!sqe) {
+                throw std::runtime_error("Очередь io_uring переполнена");
+            }
+            sqe->user_data = (static_cast<uint64_t>(slot) << 8) | op;
+            ++slots_[slot].pending;
+            return sqe;
+        }
+
+        void startStat(size_t slot);
+        void startOpenSource(size_t slot);
+        void startOpenTarget(size_t slot);
+        void startRead(size_t slot);
+        void startWrite(size_t slot);
+        void startClose(size_t slot);
+        // Возвращает true, когда файл в слоте полностью обработан
+        bool handle(size_t slot, Operation op, int result);
+        // Закрывает дескрипторы, оставшиеся открытыми после ошибки
+        void closeRemaining(size_t slot);
+    };
+
+    void UringIoEngine::startStat(size_t index) {
+        Slot& slot = slots_[index];
+        slot.stage = Stage::Stat;
+        io_uring_sqe* sqe = prepare(index, OpStat);
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>((*requests_)[slot.request].source.c_str());
+        sqe->len = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_BLOCKS;
+        sqe->off = reinterpret_cast<uint64_t>(&slot.stat);
+        sqe->statx_flags = 0;
+    }
+
+    void UringIoEngine::startOpenSource(size_t index) {
+        Slot& slot = slots_[index];
+        slot.stage = Stage::Open;
+        io_uring_sqe* sqe = prepare(index, OpOpenSource);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>((*requests_)[slot.request].source.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+
+    void UringIoEngine::startOpenTarget(size_t index) {
+        Slot& slot = slots_[index];
+        io_uring_sqe* sqe = prepare(index, OpOpenTarget);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>((*requests_)[slot.request].target.c_str());
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        sqe->len = slot.stat.stx_mode & 07777;
+    }
+
+    void UringIoEngine::startRead(size_t index) {
+        Slot& slot = slots_[index];
+        slot.stage = Stage::Read;
+        io_uring_sqe* sqe = prepare(index, OpRead);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = slot.sourceFd;
+        sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.data() + slot.done);
+        sqe->len = static_cast<uint32_t>(slot.buffer.size() - slot.done);
+        sqe->off = slot.done;
+    }
+
+    void UringIoEngine::startWrite(size_t index) {
+        Slot& slot = slots_[index];
+        slot.stage = Stage::Write;
+        io_uring_sqe* sqe = prepare(index, OpWrite);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = slot.targetFd;
+        sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.data() + slot.done);
+        sqe->len = static_cast<uint32_t>(slot.buffer.size() - slot.done);
+        sqe->off = slot.done;
+    }
+
+    void UringIoEngine::startClose(size_t index) {
+        Slot& slot = slots_[index];
+        slot.stage = Stage::Close;
+        if (slot.sourceFd >= 0) {
+            io_uring_sqe* sqe = prepare(index, OpCloseSource);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = slot.sourceFd;
+            slot.sourceFd = -1;
+        }
+        if (slot.targetFd >= 0) {
+            io_uring_sqe* sqe = prepare(index, OpCloseTarget);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = slot.targetFd;
+            slot.targetFd = -1;
+        }
+    }
+
+    void UringIoEngine::closeRemaining(size_t index) {
+        Slot& slot = slots_[index];
+        if (slot.sourceFd >= 0) {
+            close(slot.sourceFd);
+            slot.sourceFd = -1;
+        }
+        if (slot.targetFd >= 0) {
+            close(slot.targetFd);
+            slot.targetFd = -1;
+        }
+    }
+
+    bool UringIoEngine::handle(size_t index, Operation op, int result) {
+        Slot& slot = slots_[index];
+        --slot.pending;
+        if (result < 0 && !slot.error) {
+            slot.error = -result;
+        }
+
+        switch (op) {
+        case OpStat:
+            if (slot.error) {
+                return true;
+            }
+            // Разреженные файлы любого размера копируются с сохранением дыр
+            if (!S_ISREG(slot.stat.stx_mode) || slot.stat.stx_size > kSmallFileLimit ||
+                ((slot.stat.stx_mask & STATX_BLOCKS) && slot.stat.stx_blocks * 512 < slot.stat.stx_size)) {
+                largeFiles_.push_back(slot.request);
+                slot.deferred = true;
+                return true;
+            }
+            slot.buffer.resize(slot.stat.stx_size);
+            slot.done = 0;
+            startOpenSource(index);
+            return false;
+
+        case OpOpenSource:
+            if (slot.error) {
+                return true;
+            }
+            slot.sourceFd = result;
+            startOpenTarget(index);
+            return false;
+
+        case OpOpenTarget:
+            if (result >= 0) {
+                slot.targetFd = result;
+            }
+            if (slot.error || slot.buffer.empty()) {
+                startClose(index);
+            } else {
+                startRead(index);
+            }
+            return false;
+
+        case OpRead:
+            if (!slot.error && result == 0 && slot.done < slot.buffer.size()) {
+                slot.buffer.resize(slot.done); // файл укоротился во время копирования
+            } else if (!slot.error) {
+                slot.done += static_cast<uint64_t>(result);
+            }
+            if (!slot.error && slot.done < slot.buffer.size()) {
+                startRead(index);
+            } else if (!slot.error && !slot.buffer.empty()) {
+                slot.done = 0;
+                startWrite(index);
+            } else {
+                startClose(index);
+            }
+            return false;
+
+        case OpWrite:
+            if (!slot.error) {
+                slot.done += static_cast<uint64_t>(result);
+            }
+            if (!slot.error && slot.done < slot.buffer.size()) {
+                startWrite(index);
+            } else {
+                startClose(index);
+            }
+            return false;
+
+        case OpCloseSource:
+        case OpCloseTarget:
+            return slot.pending == 0;
+        }
+        return false;
+    }
+
+    void UringIoEngine::copyFiles(const std::vector<CopyRequest>& requests, const CopyCallback& onCopied) {
+        if (!ring_) {
+            throw std::runtime_error("Кольцо io_uring недоступно после предыдущей ошибки");
+        }
+        requests_ = &requests;
+        largeFiles_.clear();
+
+        std::exception_ptr failure;
+        auto fail = [&failure](std::exception_ptr error) {
+            if (!failure) {
+                failure = error;
+            }
+        };
+
+        std::vector<size_t> freeSlots;
+        for (size_t i = slots_.size(); i > 0; --i) {
+            freeSlots.push_back(i - 1);
+        }
+
+        size_t next = 0;
+        size_t active = 0;
+        while (active > 0 || (next < requests.size() && !failure)) {
+            while (!failure && next < requests.size() && !freeSlots.empty()) {
+                size_t index = freeSlots.back();
+                freeSlots.pop_back();
+                slots_[index] = Slot{};
+                slots_[index].request = next++;
+                try {
+                    startStat(index);
+                } catch (...) {
+                    fail(std::current_exception());
+                    freeSlots.push_back(index);
+                    break;
+                }
+                ++active;
+            }
+
+            try {
+                ring_->submit(1);
+            } catch (...) {
+                // Кольцо неработоспособно, а ядро еще может писать в буферы
+                // слотов: оставляем их и кольцо неосвобожденными
+                ring_.release();
+                static_cast<void>(new std::vector<Slot>(std::move(slots_)));
+                throw;
+            }
+
+            ring_->reap([&](uint64_t userData, int result) {
+                size_t index = static_cast<size_t>(userData >> 8);
+                auto op = static_cast<Operation>(userData & 0xFF);
+                Slot& slot = slots_[index];
+                bool finished = false;
+                try {
+                    finished = handle(index, op, result);
+                } catch (...) {
+                    // Новые операции для файла не запущены: ждем уже отправленные
+                    fail(std::current_exception());
+                    if (!slot.error) {
+                        slot.error = EIO;
+                    }
+                    finished = slot.pending == 0;
+                }
+                if (!finished) {
+                    return;
+                }
+                closeRemaining(index);
+
+                const CopyRequest& request = requests[slot.request];
+                if (slot.error) {
+                    fail(std::make_exception_ptr(std::runtime_error(
+                        "Ошибка копирования " + request.source.string() + ": " + errorText(slot.error))));
+                } else if (!slot.deferred && onCopied && !failure) {
+                    try {
+                        onCopied(slot.request);
+                    } catch (...) {
+                        fail(std::current_exception());
+                    }
+                }
+                slot.buffer = std::vector<char>();
+                freeSlots.push_back(index);
+                --active;
+            });
+        }
+
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+
+        // Крупные и разреженные файлы и директории - синхронно, с сохранением дыр
+        for (size_t request : largeFiles_) {
+            copySynchronously(requests[request]);
+            if (onCopied) {
+                onCopied(request);
+            }
+        }
+    }
+#endif
+}
+
+std::unique_ptr<IoEngine> IoEngine::create(unsigned queueDepth) {
+#ifdef __linux__
+    try {
+        return std::make_unique<UringIoEngine>(queueDepth);
+    } catch (const std::exception&) {
+        // io_uring отключен (старое ядро, seccomp, io_uring_disabled) - работаем синхронно
+    }
+#else
+    (void)queueDepth;
+#endif
+    return std::make_unique<SyncIoEngine>();
+}
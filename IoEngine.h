@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct CopyRequest {
+    fs::path source;
+    fs::path target;
+};
+
+// Вызывается после копирования файла requests[index]
+using CopyCallback = std::function<void(size_t index)>;
+
+// Пакетное копирование множества файлов. Реализация на io_uring держит в полете
+// сотни операций открытия/чтения/записи/закрытия; при недоступности io_uring
+// используется последовательное копирование. Большие и разреженные файлы в
+// обоих случаях копируются через copySparseFile с сохранением дыр, директории -
+// рекурсивно.
+class IoEngine {
+public:
+    virtual ~IoEngine() = default;
+
+    // Копирует все файлы; если callback бросает исключение, новые файлы не
+    // запускаются, начатые операции завершаются, и исключение пробрасывается
+    virtual void copyFiles(const std::vector<CopyRequest>& requests, const CopyCallback& onCopied) = 0;
+
+    // io_uring, если он поддерживается ядром, иначе последовательный движок
+    static std::unique_ptr<IoEngine> create(unsigned queueDepth = 512);
+};
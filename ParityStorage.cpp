@@ -0,0 +1,442 @@
+#include "ParityStorage.h"
+#include "ReedSolomon.h"
+#include "SparseFile.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <zlib.h>
+
+namespace {
+    const char* const kParityDirectory = ".parity";
+    const char* const kParityExtension = ".rs";
+
+    // Заголовок файла четности; числа хранятся в порядке байтов машины.
+    // За ним следуют номера защищенных полос, контрольные суммы их фрагментов
+    // и сама четность. Полосы, целиком попадающие в дыры, не защищаются: их
+    // содержимое - нули. metadataChecksum защищает заголовок и обе таблицы.
+    struct ParityHeader {
+        char magic[8];
+        uint32_t dataShards;
+        uint32_t parityShards;
+        uint32_t shardSize;
+        uint32_t metadataChecksum;
+        uint64_t fileSize;
+        uint64_t protectedStripes;
+    };
+    static_assert(sizeof(ParityHeader) == 40, "Неожиданный размер заголовка четности");
+
+    // Последние три символа - версия формата; 002 добавила таблицу защищенных полос
+    constexpr char kParityMagic[8] = {'B', 'K', 'P', 'R', 'S', '0', '0', '2'};
+    constexpr size_t kParityMagicPrefix = 5;
+    constexpr uint32_t kMaxShardSize = 64 * 1024 * 1024;
+
+    using StoredFile = std::pair<fs::path, fs::path>; // данные, четность
+
+    std::vector<StoredFile> collectStoredFiles(const fs::path& location) {
+        std::vector<StoredFile> files;
+        const fs::path parityDir = location / kParityDirectory;
+
+        if (fs::is_directory(location)) {
+            for (auto it = fs::recursive_directory_iterator(location);
+                 it != fs::recursive_directory_iterator(); ++it) {
+                if (it->path() == parityDir) {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                if (it->is_regular_file()) {
+                    fs::path relative = it->path().lexically_relative(location);
+                    files.emplace_back(it->path(), parityDir / (relative.string() + kParityExtension));
+                }
+            }
+        }
+
+        // ZipStorageStrategy пишет архив рядом с директорией точки восстановления
+        fs::path zipPath = location;
+        zipPath += ".zip";
+        if (fs::is_regular_file(zipPath)) {
+            files.emplace_back(zipPath, parityDir / (zipPath.filename().string() + kParityExtension));
+        }
+        return files;
+    }
+
+    // Выполняет task(i) для i в [0, count) на нескольких потоках
+    void runParallel(size_t count, const std::function<void(size_t)>& task) {
+        size_t workers = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto worker = [&]() {
+            for (size_t i = next++; i < count; i = next++) {
+                try {
+                    task(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < workers; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    uint32_t shardChecksum(const uint8_t* data, size_t len) {
+        return static_cast<uint32_t>(crc32(0L, data, static_cast<uInt>(len)));
+    }
+
+    uLong updateChecksum(uLong crc, const void* data, size_t len) {
+        const auto* bytes = static_cast<const Bytef*>(data);
+        while (len > 0) {
+            auto chunk = static_cast<uInt>(std::min<size_t>(len, 1u << 30));
+            crc = crc32(crc, bytes, chunk);
+            bytes += chunk;
+            len -= chunk;
+        }
+        return crc;
+    }
+
+    uint32_t metadataChecksum(ParityHeader header, const std::vector<uint64_t>& stripeIndex,
+                              const std::vector<uint32_t>& checksums) {
+        header.metadataChecksum = 0;
+        uLong crc = updateChecksum(crc32(0L, Z_NULL, 0), &header, sizeof(header));
+        crc = updateChecksum(crc, stripeIndex.data(), stripeIndex.size() * sizeof(uint64_t));
+        crc = updateChecksum(crc, checksums.data(), checksums.size() * sizeof(uint32_t));
+        return static_cast<uint32_t>(crc);
+    }
+
+    // Номера полос, пересекающихся с областями данных, по возрастанию
+    std::vector<uint64_t> dataStripes(const ExtentMap& map, uint64_t stripeBytes) {
+        std::vector<uint64_t> stripes;
+        for (const auto& extent : map.extents) {
+            if (extent.length == 0) {
+                continue;
+            }
+            uint64_t first = extent.offset / stripeBytes;
+            uint64_t last = (extent.offset + extent.length - 1) / stripeBytes;
+            if (!stripes.empty() && first <= stripes.back()) {
+                first = stripes.back() + 1;
+            }
+            for (uint64_t s = first; s <= last; ++s) {
+                stripes.push_back(s);
+            }
+        }
+        return stripes;
+    }
+
+    // Читает полосу данных, дополняя нулями за концом файла
+    void readStripe(std::fstream& in, uint64_t offset, uint8_t* buffer, size_t size) {
+        std::memset(buffer, 0, size);
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(offset));
+        in.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(size));
+        if (in.bad()) {
+            throw std::runtime_error("Ошибка чтения сохраненного файла");
+        }
+        in.clear();
+    }
+}
+
+ParityProtector::ParityProtector(const ParityOptions& options) : options_(options) {
+    if (!options_.enabled() || options_.dataShards == 0) {
+        throw std::invalid_argument("Число фрагментов данных и четности должно быть положительным");
+    }
+    // Каждое число проверяем отдельно, чтобы сумма не переполнилась
+    if (options_.dataShards > 255 || options_.parityShards > 255 ||
+        options_.dataShards + options_.parityShards > 256) {
+        throw std::invalid_argument("Суммарное число фрагментов не может превышать 256");
+    }
+    if (options_.shardSize == 0 || options_.shardSize > kMaxShardSize) {
+        throw std::invalid_argument("Недопустимый размер фрагмента");
+    }
+}
+
+void ParityProtector::protect(const fs::path& location) const {
+    auto files = collectStoredFiles(location);
+    runParallel(files.size(), [&](size_t i) {
+        protectFile(files[i].first, files[i].second);
+    });
+}
+
+void ParityProtector::protectFile(const fs::path& file, const fs::path& parityFile) const {
+    const unsigned k = options_.dataShards;
+    const unsigned m = options_.parityShards;
+    const size_t shardSize = options_.shardSize;
+    const uint64_t stripeBytes = static_cast<uint64_t>(k) * shardSize;
+    const ExtentMap map = readExtentMap(file);
+    const std::vector<uint64_t> stripeIndex = dataStripes(map, stripeBytes);
+
+    std::fstream in(file, std::ios::in | std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Не удалось открыть файл: " + file.string());
+    }
+    fs::create_directories(parityFile.parent_path());
+    std::ofstream out(parityFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Не удалось создать файл четности: " + parityFile.string());
+    }
+
+    ParityHeader header{};
+    std::memcpy(header.magic, kParityMagic, sizeof(kParityMagic));
+    header.dataShards = k;
+    header.parityShards = m;
+    header.shardSize = static_cast<uint32_t>(shardSize);
+    header.fileSize = map.size;
+    header.protectedStripes = stripeIndex.size();
+
+    // Таблица контрольных сумм фрагментов записывается после четности
+    std::vector<uint32_t> checksums(stripeIndex.size() * (k + m));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(stripeIndex.data()),
+              static_cast<std::streamsize>(stripeIndex.size() * sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char*>(checksums.data()),
+              static_cast<std::streamsize>(checksums.size() * sizeof(uint32_t)));
+
+    ReedSolomon rs(k, m);
+    std::vector<uint8_t> buffer((k + m) * shardSize);
+    std::vector<uint8_t*> shards(k + m);
+    for (unsigned i = 0; i < k + m; ++i) {
+        shards[i] = buffer.data() + i * shardSize;
+    }
+
+    for (size_t p = 0; p < stripeIndex.size(); ++p) {
+        readStripe(in, stripeIndex[p] * stripeBytes, buffer.data(), stripeBytes);
+        rs.encode(shards.data(), shards.data() + k, shardSize);
+        for (unsigned i = 0; i < k + m; ++i) {
+            checksums[p * (k + m) + i] = shardChecksum(shards[i], shardSize);
+        }
+        out.write(reinterpret_cast<const char*>(shards[k]), static_cast<std::streamsize>(m * shardSize));
+    }
+
+    header.metadataChecksum = metadataChecksum(header, stripeIndex, checksums);
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.seekp(static_cast<std::streamoff>(sizeof(header) + stripeIndex.size() * sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char*>(checksums.data()),
+              static_cast<std::streamsize>(checksums.size() * sizeof(uint32_t)));
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Ошибка записи файла четности: " + parityFile.string());
+    }
+}
+
+ScrubReport ParityProtector::scrub(const fs::path& location) {
+    auto files = collectStoredFiles(location);
+    ScrubReport report;
+    std::mutex reportMutex;
+
+    runParallel(files.size(), [&](size_t i) {
+        ScrubReport local;
+        local.filesChecked = 1;
+        if (!fs::exists(files[i].second)) {
+            local.unprotectedFiles = 1;
+        } else {
+            try {
+                // Поврежденные метаданные четности попадают в damagedParityFiles
+                // без изменения файла данных
+                scrubFile(files[i].first, files[i].second, local);
+            } catch (const std::exception&) {
+                local.damagedFiles.push_back(files[i].first);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(reportMutex);
+        report.filesChecked += local.filesChecked;
+        report.unprotectedFiles += local.unprotectedFiles;
+        report.stripesChecked += local.stripesChecked;
+        report.corruptShards += local.corruptShards;
+        report.repairedShards += local.repairedShards;
+        report.unrecoverableStripes += local.unrecoverableStripes;
+        report.damagedFiles.insert(report.damagedFiles.end(),
+                                   local.damagedFiles.begin(), local.damagedFiles.end());
+        report.damagedParityFiles.insert(report.damagedParityFiles.end(),
+                                         local.damagedParityFiles.begin(), local.damagedParityFiles.end());
+        report.unsupportedParityFiles.insert(report.unsupportedParityFiles.end(),
+                                             local.unsupportedParityFiles.begin(), local.unsupportedParityFiles.end());
+    });
+    return report;
+}
+
+void ParityProtector::scrubFile(const fs::path& file, const fs::path& parityFile, ScrubReport& report) {
+    // Пока заголовок и таблица не проверены, файл данных не трогаем
+    auto parityDamaged = [&]() {
+        report.damagedParityFiles.push_back(parityFile);
+    };
+
+    const uint64_t parityLength = fs::file_size(parityFile);
+    std::fstream parity(parityFile, std::ios::in | std::ios::out | std::ios::binary);
+    ParityHeader header{};
+    bool headerRead = parity && parity.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (parity.gcount() >= static_cast<std::streamsize>(sizeof(header.magic)) &&
+        std::memcmp(header.magic, kParityMagic, kParityMagicPrefix) == 0 &&
+        std::memcmp(header.magic, kParityMagic, sizeof(kParityMagic)) != 0) {
+        report.unsupportedParityFiles.push_back(parityFile);
+        return;
+    }
+    if (!headerRead ||
+        std::memcmp(header.magic, kParityMagic, sizeof(kParityMagic)) != 0 ||
+        header.dataShards == 0 || header.parityShards == 0 ||
+        header.dataShards > 255 || header.parityShards > 255 ||
+        header.dataShards + header.parityShards > 256 ||
+        header.shardSize == 0 || header.shardSize > kMaxShardSize) {
+        parityDamaged();
+        return;
+    }
+
+    const unsigned k = header.dataShards;
+    const unsigned m = header.parityShards;
+    const size_t shardSize = header.shardSize;
+    const uint64_t fileSize = header.fileSize;
+    const uint64_t stripeBytes = static_cast<uint64_t>(k) * shardSize;
+    const uint64_t stripes = fileSize / stripeBytes + (fileSize % stripeBytes != 0);
+    const uint64_t protectedStripes = header.protectedStripes;
+    const uint64_t bytesPerStripe = sizeof(uint64_t) + (k + m) * sizeof(uint32_t) +
+                                    static_cast<uint64_t>(m) * shardSize;
+
+    // Длина файла четности должна точно соответствовать заголовку
+    if (protectedStripes > stripes ||
+        protectedStripes > (parityLength - sizeof(header)) / bytesPerStripe ||
+        sizeof(header) + protectedStripes * bytesPerStripe != parityLength) {
+        parityDamaged();
+        return;
+    }
+    const uint64_t parityOffset = parityLength - protectedStripes * m * shardSize;
+
+    std::vector<uint64_t> stripeIndex(protectedStripes);
+    std::vector<uint32_t> checksums(protectedStripes * (k + m));
+    if (!parity.read(reinterpret_cast<char*>(stripeIndex.data()),
+                     static_cast<std::streamsize>(stripeIndex.size() * sizeof(uint64_t))) ||
+        !parity.read(reinterpret_cast<char*>(checksums.data()),
+                     static_cast<std::streamsize>(checksums.size() * sizeof(uint32_t))) ||
+        metadataChecksum(header, stripeIndex, checksums) != header.metadataChecksum) {
+        parityDamaged();
+        return;
+    }
+    for (size_t p = 0; p < stripeIndex.size(); ++p) {
+        if (stripeIndex[p] >= stripes || (p > 0 && stripeIndex[p] <= stripeIndex[p - 1])) {
+            parityDamaged();
+            return;
+        }
+    }
+
+    // Усеченный или удлиненный файл возвращаем к исходной длине,
+    // недостающие данные будут восстановлены как поврежденные фрагменты
+    if (fs::file_size(file) != fileSize) {
+        fs::resize_file(file, fileSize);
+    }
+
+    std::fstream data(file, std::ios::in | std::ios::out | std::ios::binary);
+    if (!data) {
+        throw std::runtime_error("Не удалось открыть файл: " + file.string());
+    }
+
+    ReedSolomon rs(k, m);
+    std::vector<uint8_t> buffer((k + m) * shardSize);
+    std::vector<uint8_t*> shards(k + m);
+    for (unsigned i = 0; i < k + m; ++i) {
+        shards[i] = buffer.data() + i * shardSize;
+    }
+    std::vector<bool> present(k + m);
+    bool damaged = false;
+
+    for (size_t p = 0; p < stripeIndex.size(); ++p) {
+        const uint64_t s = stripeIndex[p];
+        const uint32_t* expected = checksums.data() + p * (k + m);
+        const uint64_t stripeParityOffset = parityOffset + p * m * shardSize;
+
+        readStripe(data, s * stripeBytes, buffer.data(), stripeBytes);
+        readStripe(parity, stripeParityOffset, shards[k], m * shardSize);
+        ++report.stripesChecked;
+
+        unsigned bad = 0;
+        for (unsigned i = 0; i < k + m; ++i) {
+            present[i] = shardChecksum(shards[i], shardSize) == expected[i];
+            bad += present[i] ? 0 : 1;
+        }
+        if (bad == 0) {
+            continue;
+        }
+        report.corruptShards += bad;
+
+        bool repaired = bad <= m && rs.reconstruct(shards.data(), present, shardSize);
+        for (unsigned i = 0; repaired && i < k + m; ++i) {
+            repaired = present[i] || shardChecksum(shards[i], shardSize) == expected[i];
+        }
+        if (!repaired) {
+            ++report.unrecoverableStripes;
+            damaged = true;
+            continue;
+        }
+
+        for (unsigned i = 0; i < k + m; ++i) {
+            if (present[i]) {
+                continue;
+            }
+            if (i < k) {
+                uint64_t offset = s * stripeBytes + static_cast<uint64_t>(i) * shardSize;
+                if (offset >= fileSize) {
+                    continue;
+                }
+                data.seekp(static_cast<std::streamoff>(offset));
+                data.write(reinterpret_cast<const char*>(shards[i]),
+                           static_cast<std::streamsize>(std::min<uint64_t>(shardSize, fileSize - offset)));
+            } else {
+                parity.seekp(static_cast<std::streamoff>(stripeParityOffset + (i - k) * shardSize));
+                parity.write(reinterpret_cast<const char*>(shards[i]), static_cast<std::streamsize>(shardSize));
+            }
+        }
+        if (!data || !parity) {
+            throw std::runtime_error("Ошибка записи восстановленных данных: " + file.string());
+        }
+        report.repairedShards += bad;
+    }
+
+    // Полосы без четности при защите были дырами; данные, появившиеся в них
+    // с тех пор, считаются повреждением и заменяются нулями
+    const std::vector<uint8_t> zeros(shardSize, 0);
+    data.flush();
+    for (uint64_t s : dataStripes(readExtentMap(file), stripeBytes)) {
+        if (std::binary_search(stripeIndex.begin(), stripeIndex.end(), s)) {
+            continue;
+        }
+        readStripe(data, s * stripeBytes, buffer.data(), stripeBytes);
+        ++report.stripesChecked;
+
+        for (unsigned i = 0; i < k; ++i) {
+            if (std::memcmp(shards[i], zeros.data(), shardSize) == 0) {
+                continue;
+            }
+            ++report.corruptShards;
+            uint64_t offset = s * stripeBytes + static_cast<uint64_t>(i) * shardSize;
+            data.seekp(static_cast<std::streamoff>(offset));
+            data.write(reinterpret_cast<const char*>(zeros.data()),
+                       static_cast<std::streamsize>(std::min<uint64_t>(shardSize, fileSize - offset)));
+            if (!data) {
+                throw std::runtime_error("Ошибка записи восстановленных данных: " + file.string());
+            }
+            ++report.repairedShards;
+        }
+    }
+
+    if (damaged) {
+        report.damagedFiles.push_back(file);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Параметры защиты сохраненных данных кодом Рида-Соломона.
+// Файл режется на полосы по dataShards фрагментов размера shardSize,
+// к каждой полосе добавляется parityShards фрагментов четности.
+struct ParityOptions {
+    unsigned dataShards = 8;
+    unsigned parityShards = 0; // 0 - защита отключена
+    size_t shardSize = 64 * 1024;
+
+    bool enabled() const { return parityShards > 0; }
+};
+
+// Итог проверки сохраненных данных точки восстановления
+struct ScrubReport {
+    size_t filesChecked = 0;
+    size_t unprotectedFiles = 0;
+    size_t stripesChecked = 0;
+    size_t corruptShards = 0;
+    size_t repairedShards = 0;
+    size_t unrecoverableStripes = 0;
+    std::vector<fs::path> damagedFiles; // файлы, которые не удалось восстановить
+    std::vector<fs::path> damagedParityFiles; // файлы четности с поврежденными метаданными
+    std::vector<fs::path> unsupportedParityFiles; // файлы четности другой версии формата
+
+    bool clean() const {
+        return corruptShards == 0 && unprotectedFiles == 0 && damagedFiles.empty() &&
+               damagedParityFiles.empty() && unsupportedParityFiles.empty();
+    }
+};
+
+// Запись фрагментов четности для сохраненных файлов и их проверка/восстановление.
+// Четность хранится в поддиректории .parity точки восстановления и не требует
+// исходных файлов для восстановления поврежденных сегментов.
+class ParityProtector {
+public:
+    explicit ParityProtector(const ParityOptions& options);
+
+    // Защищает все файлы точки восстановления (включая соседний .zip архив)
+    void protect(const fs::path& location) const;
+
+    // Параллельно проверяет сохраненные данные и восстанавливает поврежденные сегменты
+    static ScrubReport scrub(const fs::path& location);
+
+private:
+    ParityOptions options_;
+
+    void protectFile(const fs::path& file, const fs::path& parityFile) const;
+    static void scrubFile(const fs::path& file, const fs::path& parityFile, ScrubReport& report);
+};
@@ -0,0 +1,286 @@
+#include "ReedSolomon.h"
+#include <stdexcept>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RS_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RS_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+    // Таблицы логарифмов и степеней для поля GF(2^8) с многочленом x^8 + x^4 + x^3 + x^2 + 1
+    struct GaloisTables {
+        uint8_t exp[512];
+        uint8_t log[256];
+
+        GaloisTables() {
+            unsigned x = 1;
+            for (unsigned i = 0; i < 255; ++i) {
+                exp[i] = static_cast<uint8_t>(x);
+                log[x] = static_cast<uint8_t>(i);
+                x <<= 1;
+                if (x & 0x100) {
+                    x ^= 0x11D;
+                }
+            }
+            for (unsigned i = 255; i < 512; ++i) {
+                exp[i] = exp[i - 255];
+            }
+            log[0] = 0;
+        }
+    };
+
+    const GaloisTables& tables() {
+        static const GaloisTables instance;
+        return instance;
+    }
+
+    uint8_t gfMul(uint8_t a, uint8_t b) {
+        if (a == 0 || b == 0) {
+            return 0;
+        }
+        const auto& t = tables();
+        return t.exp[t.log[a] + t.log[b]];
+    }
+
+    uint8_t gfInv(uint8_t a) {
+        if (a == 0) {
+            throw std::domain_error("Обратный элемент к нулю в GF(2^8) не существует");
+        }
+        const auto& t = tables();
+        return t.exp[255 - t.log[a]];
+    }
+
+    // dst ^= c * src. Умножение на константу раскладывается на две таблицы
+    // по 16 элементов (младший и старший полубайты), что позволяет считать
+    // 16/32 байта за инструкцию через pshufb/tbl.
+    struct MulTables {
+        alignas(16) uint8_t lo[16];
+        alignas(16) uint8_t hi[16];
+
+        explicit MulTables(uint8_t c) {
+            for (unsigned i = 0; i < 16; ++i) {
+                lo[i] = gfMul(c, static_cast<uint8_t>(i));
+                hi[i] = gfMul(c, static_cast<uint8_t>(i << 4));
+            }
+        }
+    };
+
+    void mulAddScalar(const MulTables& mt, const uint8_t* src, uint8_t* dst, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            dst[i] ^= mt.lo[src[i] & 0x0F] ^ mt.hi[src[i] >> 4];
+        }
+    }
+
+#if defined(RS_HAVE_X86_SIMD)
+    __attribute__((target("ssse3")))
+    void mulAddSsse3(const MulTables& mt, const uint8_t* src, uint8_t* dst, size_t len) {
+        const __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(mt.lo));
+        const __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(mt.hi));
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i product = _mm_xor_si128(
+                _mm_shuffle_epi8(lo, _mm_and_si128(x, mask)),
+                _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, product));
+        }
+        mulAddScalar(mt, src + i, dst + i, len - i);
+    }
+
+    __attribute__((target("avx2")))
+    void mulAddAvx2(const MulTables& mt, const uint8_t* src, uint8_t* dst, size_t len) {
+        const __m256i lo = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(mt.lo)));
+        const __m256i hi = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(mt.hi)));
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+        size_t i = 0;
+        for (; i + 32 <= len; i += 32) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            __m256i product = _mm256_xor_si256(
+                _mm256_shuffle_epi8(lo, _mm256_and_si256(x, mask)),
+                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask)));
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(d, product));
+        }
+        mulAddScalar(mt, src + i, dst + i, len - i);
+    }
+#elif defined(RS_HAVE_NEON)
+    void mulAddNeon(const MulTables& mt, const uint8_t* src, uint8_t* dst, size_t len) {
+        const uint8x16_t lo = vld1q_u8(mt.lo);
+        const uint8x16_t hi = vld1q_u8(mt.hi);
+        const uint8x16_t mask = vdupq_n_u8(0x0F);
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16) {
+            uint8x16_t x = vld1q_u8(src + i);
+            uint8x16_t product = veorq_u8(vqtbl1q_u8(lo, vandq_u8(x, mask)),
+                                          vqtbl1q_u8(hi, vshrq_n_u8(x, 4)));
+            vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), product));
+        }
+        mulAddScalar(mt, src + i, dst + i, len - i);
+    }
+#endif
+
+    using MulAddKernel = void (*)(const MulTables&, const uint8_t*, uint8_t*, size_t);
+
+    MulAddKernel selectKernel() {
+#if defined(RS_HAVE_X86_SIMD)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return mulAddAvx2;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            return mulAddSsse3;
+        }
+#elif defined(RS_HAVE_NEON)
+        return mulAddNeon;
+#endif
+        return mulAddScalar;
+    }
+
+    void gfMulAdd(uint8_t c, const uint8_t* src, uint8_t* dst, size_t len) {
+        static const MulAddKernel kernel = selectKernel();
+        if (c == 0) {
+            return;
+        }
+        if (c == 1) {
+            for (size_t i = 0; i < len; ++i) {
+                dst[i] ^= src[i];
+            }
+            return;
+        }
+        kernel(MulTables(c), src, dst, len);
+    }
+
+    // Обращение матрицы n x n методом Гаусса-Жордана
+    bool invertMatrix(std::vector<uint8_t>& m, unsigned n) {
+        std::vector<uint8_t> inv(n * n, 0);
+        for (unsigned i = 0; i < n; ++i) {
+            inv[i * n + i] = 1;
+        }
+        for (unsigned col = 0; col < n; ++col) {
+            unsigned pivot = col;
+            while (pivot < n && m[pivot * n + col] == 0) {
+                ++pivot;
+            }
+            if (pivot == n) {
+                return false;
+            }
+            if (pivot != col) {
+                for (unsigned k = 0; k < n; ++k) {
+                    std::swap(m[pivot * n + k], m[col * n + k]);
+                    std::swap(inv[pivot * n + k], inv[col * n + k]);
+                }
+            }
+            uint8_t scale = gfInv(m[col * n + col]);
+            for (unsigned k = 0; k < n; ++k) {
+                m[col * n + k] = gfMul(m[col * n + k], scale);
+                inv[col * n + k] = gfMul(inv[col * n + k], scale);
+            }
+            for (unsigned row = 0; row < n; ++row) {
+                uint8_t factor = m[row * n + col];
+                if (row == col || factor == 0) {
+                    continue;
+                }
+                for (unsigned k = 0; k < n; ++k) {
+                    m[row * n + k] ^= gfMul(factor, m[col * n + k]);
+                    inv[row * n + k] ^= gfMul(factor, inv[col * n + k]);
+                }
+            }
+        }
+        m.swap(inv);
+        return true;
+    }
+}
+
+ReedSolomon::ReedSolomon(unsigned dataShards, unsigned parityShards)
+    : dataShards_(dataShards), parityShards_(parityShards) {
+    if (dataShards_ == 0 || parityShards_ == 0) {
+        throw std::invalid_argument("Число фрагментов данных и четности должно быть положительным");
+    }
+    // Каждое число проверяем отдельно, чтобы сумма не переполнилась
+    if (dataShards_ > 255 || parityShards_ > 255 || dataShards_ + parityShards_ > 256) {
+        throw std::invalid_argument("Суммарное число фрагментов не может превышать 256");
+    }
+
+    // Матрица Коши: a[i][j] = 1 / (x_i + y_j), x_i = dataShards + i, y_j = j
+    parityMatrix_.resize(parityShards_ * dataShards_);
+    for (unsigned i = 0; i < parityShards_; ++i) {
+        for (unsigned j = 0; j < dataShards_; ++j) {
+            parityMatrix_[i * dataShards_ + j] = gfInv(static_cast<uint8_t>((dataShards_ + i) ^ j));
+        }
+    }
+}
+
+void ReedSolomon::encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const {
+    for (unsigned i = 0; i < parityShards_; ++i) {
+        std::memset(parity[i], 0, len);
+        for (unsigned j = 0; j < dataShards_; ++j) {
+            gfMulAdd(parityCoefficient(i, j), data[j], parity[i], len);
+        }
+    }
+}
+
+bool ReedSolomon::reconstruct(uint8_t* const* shards, const std::vector<bool>& present, size_t len) const {
+    const unsigned total = dataShards_ + parityShards_;
+    if (present.size() != total) {
+        throw std::invalid_argument("Неверный размер маски фрагментов");
+    }
+
+    // Берем первые dataShards присутствующих фрагментов
+    std::vector<unsigned> rows;
+    for (unsigned i = 0; i < total && rows.size() < dataShards_; ++i) {
+        if (present[i]) {
+            rows.push_back(i);
+        }
+    }
+    if (rows.size() < dataShards_) {
+        return false;
+    }
+
+    bool dataMissing = false;
+    for (unsigned j = 0; j < dataShards_; ++j) {
+        dataMissing = dataMissing || !present[j];
+    }
+
+    if (dataMissing) {
+        std::vector<uint8_t> matrix(dataShards_ * dataShards_, 0);
+        for (unsigned r = 0; r < dataShards_; ++r) {
+            unsigned row = rows[r];
+            for (unsigned c = 0; c < dataShards_; ++c) {
+                matrix[r * dataShards_ + c] = row < dataShards_
+                    ? static_cast<uint8_t>(row == c)
+                    : parityCoefficient(row - dataShards_, c);
+            }
+        }
+        if (!invertMatrix(matrix, dataShards_)) {
+            return false;
+        }
+
+        for (unsigned j = 0; j < dataShards_; ++j) {
+            if (present[j]) {
+                continue;
+            }
+            std::memset(shards[j], 0, len);
+            for (unsigned r = 0; r < dataShards_; ++r) {
+                gfMulAdd(matrix[j * dataShards_ + r], shards[rows[r]], shards[j], len);
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < parityShards_; ++i) {
+        if (present[dataShards_ + i]) {
+            continue;
+        }
+        uint8_t* parity = shards[dataShards_ + i];
+        std::memset(parity, 0, len);
+        for (unsigned j = 0; j < dataShards_; ++j) {
+            gfMulAdd(parityCoefficient(i, j), shards[j], parity, len);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Систематический код Рида-Соломона над GF(2^8) с матрицей Коши.
+// Любые dataShards из dataShards + parityShards фрагментов восстанавливают остальные.
+class ReedSolomon {
+public:
+    ReedSolomon(unsigned dataShards, unsigned parityShards);
+
+    unsigned dataShards() const { return dataShards_; }
+    unsigned parityShards() const { return parityShards_; }
+
+    // data - dataShards буферов, parity - parityShards буферов, все длиной len
+    void encode(const uint8_t* const* data, uint8_t* const* parity, size_t len) const;
+
+    // shards - dataShards + parityShards буферов длиной len; отсутствующие
+    // фрагменты (present[i] == false) перезаписываются восстановленными данными.
+    // Возвращает false, если присутствующих фрагментов недостаточно.
+    bool reconstruct(uint8_t* const* shards, const std::vector<bool>& present, size_t len) const;
+
+private:
+    unsigned dataShards_;
+    unsigned parityShards_;
+    std::vector<uint8_t> parityMatrix_; // parityShards_ x dataShards_
+
+    uint8_t parityCoefficient(unsigned row, unsigned col) const {
+        return parityMatrix_[row * dataShards_ + col];
+    }
+};
@@ -0,0 +1,243 @@
+#include "SparseFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+uint64_t ExtentMap::dataBytes() const {
+    uint64_t total = 0;
+    for (const auto& extent : extents) {
+        total += extent.length;
+    }
+    return total;
+}
+
+#ifdef __linux__
+
+namespace {
+    // Закрывает дескриптор при выходе из области видимости
+    class FileDescriptor {
+    public:
+        explicit FileDescriptor(int fd) : fd_(fd) {}
+        ~FileDescriptor() {
+            if (fd_ >= 0) {
+                ::close(fd_);
+            }
+        }
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+        int get() const { return fd_; }
+
+    private:
+        int fd_;
+    };
+
+    std::runtime_error systemError(const std::string& message, const fs::path& path) {
+        return std::runtime_error(message + " " + path.string() + ": " + std::strerror(errno));
+    }
+
+    // Добавляет область, объединяя ее с предыдущей, если они смежные
+    void appendExtent(std::vector<Extent>& extents, uint64_t offset, uint64_t length, uint64_t size) {
+        if (offset >= size || length == 0) {
+            return;
+        }
+        length = std::min(length, size - offset);
+        if (!extents.empty() && extents.back().offset + extents.back().length >= offset) {
+            uint64_t end = std::max(extents.back().offset + extents.back().length, offset + length);
+            extents.back().length = end - extents.back().offset;
+            return;
+        }
+        extents.push_back({offset, length});
+    }
+
+    bool mapWithFiemap(int fd, ExtentMap& map) {
+        constexpr unsigned kBatch = 256;
+        std::unique_ptr<char[]> storage(new char[sizeof(fiemap) + kBatch * sizeof(fiemap_extent)]);
+        auto* request = reinterpret_cast<fiemap*>(storage.get());
+
+        uint64_t start = 0;
+        while (start < map.size) {
+            std::memset(request, 0, sizeof(fiemap));
+            request->fm_start = start;
+            request->fm_length = FIEMAP_MAX_OFFSET - start;
+            request->fm_flags = FIEMAP_FLAG_SYNC;
+            request->fm_extent_count = kBatch;
+            if (ioctl(fd, FS_IOC_FIEMAP, request) < 0) {
+                return false;
+            }
+            if (request->fm_mapped_extents == 0) {
+                break;
+            }
+
+            bool last = false;
+            for (unsigned i = 0; i < request->fm_mapped_extents; ++i) {
+                const fiemap_extent& extent = request->fm_extents[i];
+                if (!(extent.fe_flags & FIEMAP_EXTENT_UNWRITTEN)) {
+                    appendExtent(map.extents, extent.fe_logical, extent.fe_length, map.size);
+                }
+                start = extent.fe_logical + extent.fe_length;
+                last = last || (extent.fe_flags & FIEMAP_EXTENT_LAST);
+            }
+            if (last) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool mapWithSeek(int fd, ExtentMap& map) {
+        uint64_t offset = 0;
+        while (offset < map.size) {
+            off_t data = lseek(fd, static_cast<off_t>(offset), SEEK_DATA);
+            if (data < 0) {
+                if (errno == ENXIO) {
+                    break; // дальше только дыры
+                }
+                return false;
+            }
+            off_t hole = lseek(fd, data, SEEK_HOLE);
+            if (hole < 0) {
+                return false;
+            }
+            appendExtent(map.extents, static_cast<uint64_t>(data),
+                         static_cast<uint64_t>(hole - data), map.size);
+            offset = static_cast<uint64_t>(hole);
+        }
+        return true;
+    }
+
+    ExtentMap mapDescriptor(int fd, uint64_t size) {
+        ExtentMap map;
+        map.size = size;
+        if (size == 0) {
+            return map;
+        }
+        if (mapWithFiemap(fd, map)) {
+            return map;
+        }
+        map.extents.clear();
+        if (mapWithSeek(fd, map)) {
+            return map;
+        }
+        map.extents.assign(1, Extent{0, size});
+        return map;
+    }
+
+    void copyRange(int from, int to, uint64_t offset, uint64_t length, const fs::path& source) {
+        static thread_local std::unique_ptr<char[]> buffer;
+        constexpr size_t kBufferSize = 256 * 1024;
+
+        bool useCopyRange = true;
+        while (length > 0) {
+            if (useCopyRange) {
+                loff_t inOffset = static_cast<loff_t>(offset);
+                loff_t outOffset = static_cast<loff_t>(offset);
+                ssize_t copied = copy_file_range(from, &inOffset, to, &outOffset, length, 0);
+                if (copied > 0) {
+                    offset += static_cast<uint64_t>(copied);
+                    length -= static_cast<uint64_t>(copied);
+                    continue;
+                }
+                if (copied == 0) {
+                    throw std::runtime_error("Файл изменился во время копирования: " + source.string());
+                }
+                if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+                    throw systemError("Ошибка копирования", source);
+                }
+                useCopyRange = false;
+            }
+
+            if (!buffer) {
+                buffer.reset(new char[kBufferSize]);
+            }
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(length, kBufferSize));
+            ssize_t got = pread(from, buffer.get(), chunk, static_cast<off_t>(offset));
+            if (got <= 0) {
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                throw systemError("Ошибка чтения", source);
+            }
+            for (ssize_t written = 0; written < got;) {
+                ssize_t rc = pwrite(to, buffer.get() + written, static_cast<size_t>(got - written),
+                                    static_cast<off_t>(offset + written));
+                if (rc < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error(std::string("Ошибка записи: ") + std::strerror(errno));
+                }
+                written += rc;
+            }
+            offset += static_cast<uint64_t>(got);
+            length -= static_cast<uint64_t>(got);
+        }
+    }
+}
+
+ExtentMap readExtentMap(const fs::path& path) {
+    FileDescriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0) {
+        throw systemError("Не удалось открыть файл", path);
+    }
+    struct stat st;
+    if (fstat(fd.get(), &st) < 0) {
+        throw systemError("Не удалось получить сведения о файле", path);
+    }
+    return mapDescriptor(fd.get(), static_cast<uint64_t>(st.st_size));
+}
+
+void copySparseFile(const fs::path& from, const fs::path& to) {
+    FileDescriptor source(::open(from.c_str(), O_RDONLY | O_CLOEXEC));
+    if (source.get() < 0) {
+        throw systemError("Не удалось открыть файл", from);
+    }
+    struct stat st;
+    if (fstat(source.get(), &st) < 0) {
+        throw systemError("Не удалось получить сведения о файле", from);
+    }
+
+    FileDescriptor target(::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777));
+    if (target.get() < 0) {
+        throw systemError("Не удалось создать файл", to);
+    }
+
+    // Установка размера создает файл, целиком состоящий из дыры
+    if (ftruncate(target.get(), st.st_size) < 0) {
+        throw systemError("Не удалось установить размер файла", to);
+    }
+
+    ExtentMap map = mapDescriptor(source.get(), static_cast<uint64_t>(st.st_size));
+    for (const auto& extent : map.extents) {
+        copyRange(source.get(), target.get(), extent.offset, extent.length, from);
+    }
+}
+
+#else
+
+ExtentMap readExtentMap(const fs::path& path) {
+    ExtentMap map;
+    map.size = fs::file_size(path);
+    if (map.size > 0) {
+        map.extents.push_back({0, map.size});
+    }
+    return map;
+}
+
+void copySparseFile(const fs::path& from, const fs::path& to) {
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+}
+
+#endif
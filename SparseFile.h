@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Область файла, содержащая данные; все, что вне областей, - дыры
+struct Extent {
+    uint64_t offset;
+    uint64_t length;
+};
+
+// Карта данных файла: логический размер и отсортированные непересекающиеся области
+struct ExtentMap {
+    uint64_t size = 0;
+    std::vector<Extent> extents;
+
+    uint64_t dataBytes() const;
+    bool isSparse() const { return dataBytes() < size; }
+};
+
+// Строит карту через FIEMAP, при его отсутствии - через SEEK_DATA/SEEK_HOLE.
+// Нераспределенные (unwritten) области считаются дырами. Если ни один способ
+// недоступен, весь файл считается одной областью данных.
+ExtentMap readExtentMap(const fs::path& path);
+
+// Копирует только области данных, дыры в целевом файле воссоздаются как дыры
+void copySparseFile(const fs::path& from, const fs::path& to);
@@ -1,9 +1,103 @@
 #include "StorageStrategies.h"
+#include "SparseFile.h"
+#include "IoEngine.h"
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include <zlib.h>
+
+namespace {
+    // Формат зашифрованного файла: magic | соль | IV | размер | число областей |
+    // области (смещение, длина) | шифротекст сжатого потока областей данных | тег GCM.
+    // Дыры не читаются и не хранятся - их описывает только карта областей.
+    constexpr char kEncryptedMagic[8] = {'B', 'K', 'P', 'E', 'N', 'C', '0', '2'};
+    constexpr size_t kSaltSize = 16;
+    constexpr size_t kIvSize = 12;
+    constexpr size_t kTagSize = 16;
+    constexpr size_t kFixedHeaderSize = sizeof(kEncryptedMagic) + kSaltSize + kIvSize +
+                                        sizeof(uint64_t) + sizeof(uint32_t);
+    constexpr size_t kChunkSize = 64 * 1024;
+    constexpr int kKdfIterations = 200000;
+
+    struct CipherCtxDeleter {
+        void operator()(EVP_CIPHER_CTX* ctx) const { EVP_CIPHER_CTX_free(ctx); }
+    };
+    using CipherCtxPtr = std::unique_ptr<EVP_CIPHER_CTX, CipherCtxDeleter>;
+
+    CipherCtxPtr makeCipherCtx() {
+        CipherCtxPtr ctx(EVP_CIPHER_CTX_new());
+        if (!ctx) {
+            throw std::runtime_error("Не удалось создать контекст шифрования");
+        }
+        return ctx;
+    }
+
+    // Владеет z_stream и освобождает его при выходе из области видимости
+    class ZStream {
+    public:
+        explicit ZStream(bool deflating) : deflating_(deflating) {
+            std::memset(&stream_, 0, sizeof(stream_));
+            int rc = deflating_ ? deflateInit(&stream_, Z_BEST_SPEED) : inflateInit(&stream_);
+            if (rc != Z_OK) {
+                throw std::runtime_error("Не удалось инициализировать zlib");
+            }
+        }
+        ~ZStream() {
+            if (deflating_) {
+                deflateEnd(&stream_);
+            } else {
+                inflateEnd(&stream_);
+            }
+        }
+        ZStream(const ZStream&) = delete;
+        ZStream& operator=(const ZStream&) = delete;
+
+        z_stream* get() { return &stream_; }
+
+    private:
+        z_stream stream_;
+        bool deflating_;
+    };
+
+    void writeBytes(std::ofstream& out, const unsigned char* data, size_t size) {
+        if (size > 0 && !out.write(reinterpret_cast<const char*>(data), size)) {
+            throw std::runtime_error("Ошибка записи зашифрованных данных");
+        }
+    }
+}
+
+void BatchCopyStorageStrategy::restoreFiles(const std::vector<CopyRequest>& files,
+                                            const CopyCallback& onRestored) {
+    // Исключения callback (например, отмена) пробрасываются как есть
+    bool callbackFailed = false;
+    try {
+        IoEngine::create()->copyFiles(files, [&](size_t index) {
+            if (onRestored) {
+                try {
+                    onRestored(index);
+                } catch (...) {
+                    callbackFailed = true;
+                    throw;
+                }
+            }
+        });
+    } catch (const std::exception& e) {
+        if (callbackFailed) {
+            throw;
+        }
+        throw std::runtime_error("Ошибка при восстановлении файла: " + std::string(e.what()));
+    }
+}
 
 void SplitStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject>>& objects,
                                 const fs::path& destination) {
+    std::vector<CopyRequest> requests;
+    requests.reserve(objects.size());
+
     for (const auto& obj : objects) {
         if (!obj->exists()) {
             throw std::runtime_error("Объект для резервного копирования не существует: " + 
@@ -14,10 +108,11 @@ void SplitStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject>
         fs::path objDestination = destination / obj->getPath().filename();
         fs::create_directories(objDestination);
 
-        // Копируем файл в новую директорию
-        fs::copy(obj->getPath(), objDestination / obj->getPath().filename(),
-                fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+        requests.push_back({obj->getPath(), objDestination / obj->getPath().filename()});
     }
+
+    // Копируем файлы в новые директории одним пакетом
+    IoEngine::create()->copyFiles(requests, nullptr);
 }
 
 void SingleStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject>>& objects,
@@ -25,21 +120,26 @@ void SingleStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject
     // Создаем одну общую директорию для всех объектов
     fs::create_directories(destination);
 
+    std::vector<CopyRequest> requests;
+    requests.reserve(objects.size());
+
     for (const auto& obj : objects) {
         if (!obj->exists()) {
             throw std::runtime_error("Объект для резервного копирования не существует: " + 
                                    obj->getPath().string());
         }
-
-        // Копируем все файлы в общую директорию
-        fs::copy(obj->getPath(), destination / obj->getPath().filename(),
-                fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+        requests.push_back({obj->getPath(), destination / obj->getPath().filename()});
     }
+
+    // Копируем все файлы в общую директорию одним пакетом
+    IoEngine::create()->copyFiles(requests, nullptr);
 }
 
 void SimpleStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject>>& objects,
                                 const fs::path& destination) {
     std::error_code ec;
+    std::vector<CopyRequest> requests;
+    requests.reserve(objects.size());
     
     for (const auto& obj : objects) {
         if (!obj->exists()) {
@@ -55,11 +155,10 @@ void SimpleStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject
             }
         }
 
-        fs::copy_file(obj->getPath(), destPath, fs::copy_options::overwrite_existing, ec);
-        if (ec) {
-            throw std::runtime_error("Ошибка копирования файла: " + ec.message());
-        }
+        requests.push_back({obj->getPath(), destPath});
     }
+
+    IoEngine::create()->copyFiles(requests, nullptr);
 }
 
 void ZipStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject>>& objects,
@@ -104,4 +203,327 @@ void ZipStorageStrategy::addToZip(zip_t* archive, const fs::path& filePath, cons
         zip_source_free(source);
         throw std::runtime_error("Не удалось добавить файл в архив");
     }
-} 
\ No newline at end of file
+}
+
+EncryptedStorageStrategy::EncryptedStorageStrategy(std::string passphrase)
+    : passphrase_(std::move(passphrase)) {
+    if (passphrase_.empty()) {
+        throw std::invalid_argument("Пароль шифрования не может быть пустым");
+    }
+}
+
+EncryptedStorageStrategy::~EncryptedStorageStrategy() {
+    OPENSSL_cleanse(cachedKey_.data(), cachedKey_.size());
+    OPENSSL_cleanse(&passphrase_[0], passphrase_.size());
+}
+
+const EncryptedStorageStrategy::Key& EncryptedStorageStrategy::deriveKey(const Salt& salt) {
+    if (hasCachedKey_ && cachedSalt_ == salt) {
+        return cachedKey_;
+    }
+    if (PKCS5_PBKDF2_HMAC(passphrase_.data(), static_cast<int>(passphrase_.size()),
+                          salt.data(), static_cast<int>(salt.size()), kKdfIterations,
+                          EVP_sha256(), static_cast<int>(cachedKey_.size()), cachedKey_.data()) != 1) {
+        hasCachedKey_ = false;
+        throw std::runtime_error("Не удалось получить ключ шифрования");
+    }
+    cachedSalt_ = salt;
+    hasCachedKey_ = true;
+    return cachedKey_;
+}
+
+void EncryptedStorageStrategy::store(const std::vector<std::shared_ptr<BackupObject>>& objects,
+                                     const fs::path& destination) {
+    fs::create_directories(destination);
+
+    Salt salt;
+    if (RAND_bytes(salt.data(), static_cast<int>(salt.size())) != 1) {
+        throw std::runtime_error("Не удалось сгенерировать соль");
+    }
+    const Key& key = deriveKey(salt);
+
+    for (const auto& obj : objects) {
+        if (!obj->exists()) {
+            throw std::runtime_error("Файл не существует: " + obj->getPath().string());
+        }
+        encryptFile(obj->getPath(), destination / obj->getPath().filename(), salt, key);
+    }
+}
+
+void EncryptedStorageStrategy::encryptFile(const fs::path& source, const fs::path& target,
+                                           const Salt& salt, const Key& key) {
+    ExtentMap map = readExtentMap(source);
+
+    std::ifstream in(source, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Не удалось открыть файл: " + source.string());
+    }
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Не удалось создать файл: " + target.string());
+    }
+
+    unsigned char iv[kIvSize];
+    if (RAND_bytes(iv, sizeof(iv)) != 1) {
+        throw std::runtime_error("Не удалось сгенерировать IV");
+    }
+
+    // Числа в заголовке хранятся в порядке байтов машины
+    auto extentCount = static_cast<uint32_t>(map.extents.size());
+    std::vector<unsigned char> header(kFixedHeaderSize + map.extents.size() * sizeof(Extent));
+    unsigned char* cursor = header.data();
+    auto put = [&cursor](const void* data, size_t size) {
+        std::memcpy(cursor, data, size);
+        cursor += size;
+    };
+    put(kEncryptedMagic, sizeof(kEncryptedMagic));
+    put(salt.data(), salt.size());
+    put(iv, sizeof(iv));
+    put(&map.size, sizeof(map.size));
+    put(&extentCount, sizeof(extentCount));
+    if (!map.extents.empty()) {
+        put(map.extents.data(), map.extents.size() * sizeof(Extent));
+    }
+    writeBytes(out, header.data(), header.size());
+
+    auto ctx = makeCipherCtx();
+    int outLen = 0;
+    if (EVP_EncryptInit_ex(ctx.get(), EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, kIvSize, nullptr) != 1 ||
+        EVP_EncryptInit_ex(ctx.get(), nullptr, nullptr, key.data(), iv) != 1 ||
+        // Заголовок вместе с картой областей аутентифицируется как AAD
+        EVP_EncryptUpdate(ctx.get(), nullptr, &outLen, header.data(), static_cast<int>(header.size())) != 1) {
+        throw std::runtime_error("Не удалось инициализировать шифрование");
+    }
+
+    ZStream zs(true);
+    std::vector<unsigned char> plain(kChunkSize);
+    std::vector<unsigned char> compressed(kChunkSize);
+    std::vector<unsigned char> cipher(kChunkSize + EVP_MAX_BLOCK_LENGTH);
+
+    // Сжатый блок сразу же шифруется и пишется - данные проходят файл один раз
+    auto compressAndEncrypt = [&](const unsigned char* data, size_t size, int flush) {
+        zs.get()->next_in = const_cast<unsigned char*>(data);
+        zs.get()->avail_in = static_cast<uInt>(size);
+        do {
+            zs.get()->next_out = compressed.data();
+            zs.get()->avail_out = static_cast<uInt>(compressed.size());
+            if (deflate(zs.get(), flush) == Z_STREAM_ERROR) {
+                throw std::runtime_error("Ошибка сжатия");
+            }
+            size_t produced = compressed.size() - zs.get()->avail_out;
+            if (produced > 0) {
+                int len = 0;
+                if (EVP_EncryptUpdate(ctx.get(), cipher.data(), &len, compressed.data(),
+                                      static_cast<int>(produced)) != 1) {
+                    throw std::runtime_error("Ошибка шифрования");
+                }
+                writeBytes(out, cipher.data(), static_cast<size_t>(len));
+            }
+        } while (zs.get()->avail_out == 0);
+    };
+
+    for (const auto& extent : map.extents) {
+        in.seekg(static_cast<std::streamoff>(extent.offset));
+        uint64_t remaining = extent.length;
+        while (remaining > 0) {
+            auto toRead = static_cast<size_t>(std::min<uint64_t>(remaining, plain.size()));
+            if (!in.read(reinterpret_cast<char*>(plain.data()), static_cast<std::streamsize>(toRead))) {
+                throw std::runtime_error("Ошибка чтения файла: " + source.string());
+            }
+            compressAndEncrypt(plain.data(), toRead, Z_NO_FLUSH);
+            remaining -= toRead;
+        }
+    }
+    compressAndEncrypt(nullptr, 0, Z_FINISH);
+
+    unsigned char tag[kTagSize];
+    if (EVP_EncryptFinal_ex(ctx.get(), cipher.data(), &outLen) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, kTagSize, tag) != 1) {
+        throw std::runtime_error("Ошибка завершения шифрования");
+    }
+    writeBytes(out, cipher.data(), static_cast<size_t>(outLen));
+    writeBytes(out, tag, sizeof(tag));
+
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Ошибка записи файла: " + target.string());
+    }
+}
+
+void EncryptedStorageStrategy::restoreFile(const fs::path& storedPath, const fs::path& targetPath) {
+    std::error_code ec;
+    auto fileSize = fs::file_size(storedPath, ec);
+    if (ec) {
+        throw std::runtime_error("Не удалось получить размер файла: " + ec.message());
+    }
+    if (fileSize < kFixedHeaderSize + kTagSize) {
+        throw std::runtime_error("Поврежденный зашифрованный файл: " + storedPath.string());
+    }
+
+    std::ifstream in(storedPath, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Не удалось открыть файл: " + storedPath.string());
+    }
+
+    std::vector<unsigned char> header(kFixedHeaderSize);
+    if (!in.read(reinterpret_cast<char*>(header.data()), static_cast<std::streamsize>(header.size())) ||
+        std::memcmp(header.data(), kEncryptedMagic, sizeof(kEncryptedMagic)) != 0) {
+        throw std::runtime_error("Файл не является зашифрованной резервной копией: " + storedPath.string());
+    }
+
+    const unsigned char* cursor = header.data() + sizeof(kEncryptedMagic);
+    Salt salt;
+    std::memcpy(salt.data(), cursor, salt.size());
+    unsigned char iv[kIvSize];
+    std::memcpy(iv, cursor + kSaltSize, sizeof(iv));
+    ExtentMap map;
+    uint32_t extentCount = 0;
+    std::memcpy(&map.size, cursor + kSaltSize + kIvSize, sizeof(map.size));
+    std::memcpy(&extentCount, cursor + kSaltSize + kIvSize + sizeof(map.size), sizeof(extentCount));
+
+    if (extentCount > (fileSize - kFixedHeaderSize - kTagSize) / sizeof(Extent)) {
+        throw std::runtime_error("Поврежденный зашифрованный файл: " + storedPath.string());
+    }
+    map.extents.resize(extentCount);
+    header.resize(kFixedHeaderSize + extentCount * sizeof(Extent));
+    if (extentCount > 0 &&
+        !in.read(reinterpret_cast<char*>(header.data() + kFixedHeaderSize),
+                 static_cast<std::streamsize>(extentCount * sizeof(Extent)))) {
+        throw std::runtime_error("Ошибка чтения файла: " + storedPath.string());
+    }
+    std::memcpy(map.extents.data(), header.data() + kFixedHeaderSize, extentCount * sizeof(Extent));
+
+    // Заголовок еще не аутентифицирован, поэтому проверяем, что области
+    // упорядочены и не выходят за размер файла
+    uint64_t previousEnd = 0;
+    for (const auto& extent : map.extents) {
+        if (extent.offset < previousEnd || extent.length == 0 ||
+            extent.length > map.size || extent.offset > map.size - extent.length) {
+            throw std::runtime_error("Поврежденный зашифрованный файл: " + storedPath.string());
+        }
+        previousEnd = extent.offset + extent.length;
+    }
+
+    const Key& key = deriveKey(salt);
+
+    auto ctx = makeCipherCtx();
+    int outLen = 0;
+    if (EVP_DecryptInit_ex(ctx.get(), EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
+        EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, kIvSize, nullptr) != 1 ||
+        EVP_DecryptInit_ex(ctx.get(), nullptr, nullptr, key.data(), iv) != 1 ||
+        EVP_DecryptUpdate(ctx.get(), nullptr, &outLen, header.data(), static_cast<int>(header.size())) != 1) {
+        throw std::runtime_error("Не удалось инициализировать расшифровку");
+    }
+
+    // Пишем во временный файл и переименовываем только после проверки тега
+    fs::path tempPath = targetPath;
+    tempPath += ".part";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Не удалось создать файл: " + tempPath.string());
+    }
+
+    try {
+        ZStream zs(false);
+        std::vector<unsigned char> cipher(kChunkSize);
+        std::vector<unsigned char> compressed(kChunkSize + EVP_MAX_BLOCK_LENGTH);
+        std::vector<unsigned char> plain(kChunkSize);
+        bool streamEnded = false;
+        bool inflateFailed = false;
+        size_t extentIndex = 0;
+        uint64_t extentPosition = 0;
+
+        // Раскладывает распакованный поток по областям данных, пропуская дыры
+        auto writePlain = [&](const unsigned char* data, size_t size) {
+            while (size > 0) {
+                if (extentIndex >= map.extents.size()) {
+                    return false;
+                }
+                const Extent& extent = map.extents[extentIndex];
+                if (extentPosition == 0) {
+                    out.seekp(static_cast<std::streamoff>(extent.offset));
+                }
+                auto count = static_cast<size_t>(std::min<uint64_t>(size, extent.length - extentPosition));
+                writeBytes(out, data, count);
+                data += count;
+                size -= count;
+                extentPosition += count;
+                if (extentPosition == extent.length) {
+                    ++extentIndex;
+                    extentPosition = 0;
+                }
+            }
+            return true;
+        };
+
+        // Ошибку распаковки не выбрасываем сразу: сначала нужно дочитать поток и проверить тег
+        auto inflateAndWrite = [&](const unsigned char* data, size_t size) {
+            if (inflateFailed) {
+                return;
+            }
+            zs.get()->next_in = const_cast<unsigned char*>(data);
+            zs.get()->avail_in = static_cast<uInt>(size);
+            do {
+                zs.get()->next_out = plain.data();
+                zs.get()->avail_out = static_cast<uInt>(plain.size());
+                int rc = inflate(zs.get(), Z_NO_FLUSH);
+                if (rc == Z_STREAM_END) {
+                    streamEnded = true;
+                } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                    inflateFailed = true;
+                    return;
+                }
+                if (!writePlain(plain.data(), plain.size() - zs.get()->avail_out)) {
+                    inflateFailed = true;
+                    return;
+                }
+            } while (!streamEnded && zs.get()->avail_out == 0);
+        };
+
+        auto remaining = fileSize - header.size() - kTagSize;
+        while (remaining > 0) {
+            auto toRead = static_cast<std::streamsize>(std::min<uintmax_t>(remaining, cipher.size()));
+            if (!in.read(reinterpret_cast<char*>(cipher.data()), toRead)) {
+                throw std::runtime_error("Ошибка чтения файла: " + storedPath.string());
+            }
+            remaining -= static_cast<uintmax_t>(toRead);
+
+            int len = 0;
+            if (EVP_DecryptUpdate(ctx.get(), compressed.data(), &len, cipher.data(),
+                                  static_cast<int>(toRead)) != 1) {
+                throw std::runtime_error("Ошибка расшифровки");
+            }
+            inflateAndWrite(compressed.data(), static_cast<size_t>(len));
+        }
+
+        unsigned char tag[kTagSize];
+        if (!in.read(reinterpret_cast<char*>(tag), sizeof(tag))) {
+            throw std::runtime_error("Ошибка чтения тега целостности: " + storedPath.string());
+        }
+        if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, kTagSize, tag) != 1 ||
+            EVP_DecryptFinal_ex(ctx.get(), compressed.data(), &outLen) != 1) {
+            throw std::runtime_error("Нарушена целостность зашифрованного файла: " + storedPath.string());
+        }
+        if (inflateFailed || !streamEnded || extentIndex != map.extents.size()) {
+            throw std::runtime_error("Поврежденный сжатый поток: " + storedPath.string());
+        }
+
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Ошибка записи файла: " + tempPath.string());
+        }
+        // Хвостовая дыра воссоздается установкой размера
+        fs::resize_file(tempPath, map.size);
+    } catch (...) {
+        out.close();
+        fs::remove(tempPath, ec);
+        throw;
+    }
+
+    fs::rename(tempPath, targetPath, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        throw std::runtime_error("Ошибка при восстановлении файла: " + targetPath.string());
+    }
+}
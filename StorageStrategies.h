@@ -5,22 +5,30 @@
 #include <zip.h>
 #include <sstream>
 #include <ctime>
+#include <array>
+#include <string>
+
+// Стратегии, хранящие файлы как есть: восстановление идет пакетом через IoEngine
+class BatchCopyStorageStrategy : public IStorageStrategy {
+public:
+    void restoreFiles(const std::vector<CopyRequest>& files, const CopyCallback& onRestored) override;
+};
 
 // Стратегия раздельного хранения - каждый объект в отдельной директории
-class SplitStorageStrategy : public IStorageStrategy {
+class SplitStorageStrategy : public BatchCopyStorageStrategy {
 public:
     void store(const std::vector<std::shared_ptr<BackupObject>>& objects,
                const fs::path& destination) override;
 };
 
 // Стратегия общего хранилища - все объекты в одной директории
-class SingleStorageStrategy : public IStorageStrategy {
+class SingleStorageStrategy : public BatchCopyStorageStrategy {
 public:
     void store(const std::vector<std::shared_ptr<BackupObject>>& objects,
                const fs::path& destination) override;
 };
 
-class SimpleStorageStrategy : public IStorageStrategy {
+class SimpleStorageStrategy : public BatchCopyStorageStrategy {
 public:
     void store(const std::vector<std::shared_ptr<BackupObject>>& objects,
                const fs::path& destination) override;
@@ -32,4 +40,32 @@ public:
                const fs::path& destination) override;
 private:
     static void addToZip(zip_t* archive, const fs::path& filePath, const std::string& entryName);
-}; 
\ No newline at end of file
+};
+
+// Стратегия зашифрованного хранения - каждый файл сжимается (zlib) и шифруется
+// AES-256-GCM за один потоковый проход, тег целостности проверяется при восстановлении
+class EncryptedStorageStrategy : public IStorageStrategy {
+public:
+    explicit EncryptedStorageStrategy(std::string passphrase);
+    ~EncryptedStorageStrategy() override;
+
+    void store(const std::vector<std::shared_ptr<BackupObject>>& objects,
+               const fs::path& destination) override;
+    void restoreFile(const fs::path& storedPath, const fs::path& targetPath) override;
+
+private:
+    static constexpr size_t kSaltSize = 16;
+    static constexpr size_t kKeySize = 32;
+    using Salt = std::array<unsigned char, kSaltSize>;
+    using Key = std::array<unsigned char, kKeySize>;
+
+    std::string passphrase_;
+    Salt cachedSalt_{};
+    Key cachedKey_{};
+    bool hasCachedKey_ = false;
+
+    // Ключ выводится из пароля один раз на соль (одна соль на точку восстановления)
+    const Key& deriveKey(const Salt& salt);
+    static void encryptFile(const fs::path& source, const fs::path& target,
+                            const Salt& salt, const Key& key);
+};
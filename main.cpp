@@ -1,7 +1,22 @@
 #include "BackupSystem.h"
 #include "StorageStrategies.h"
+#include "ChangeTracker.h"
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <cstdlib>
+#include <csignal>
+
+namespace {
+    volatile std::sig_atomic_t stopRequested = 0;
+
+    // Верхняя граница интервала службы, чтобы срок следующей точки не переполнился
+    constexpr long long kMaxDaemonIntervalSeconds = 365LL * 24 * 60 * 60;
+
+    void handleStopSignal(int) {
+        stopRequested = 1;
+    }
+}
 
 void printHelp() {
     std::cout << "Команды:" << std::endl;
@@ -9,18 +24,88 @@ void printHelp() {
     std::cout << "2. backup - создать точку восстановления" << std::endl;
     std::cout << "3. restore <номер_точки> <путь_для_восстановления> - восстановить файлы" << std::endl;
     std::cout << "4. list - показать все точки восстановления" << std::endl;
-    std::cout << "5. exit - выход" << std::endl;
+    std::cout << "5. parity <фрагменты_данных> <фрагменты_четности> - включить защиту четностью (0 - отключить)" << std::endl;
+    std::cout << "6. scrub <номер_точки> - проверить сохраненные данные и восстановить по четности" << std::endl;
+    std::cout << "7. exit - выход" << std::endl;
+}
+
+// Непрерывное резервное копирование: по расписанию создаются точки восстановления
+// только из файлов, измененных с момента предыдущей точки
+int runDaemon(BackupJob& backup, std::chrono::seconds interval, const std::vector<fs::path>& paths) {
+    ChangeTracker tracker;
+    for (const auto& path : paths) {
+        try {
+            backup.addObject(path);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка при добавлении файла: " << e.what() << std::endl;
+            return 1;
+        }
+        tracker.watch(path);
+    }
+
+    std::signal(SIGINT, handleStopSignal);
+    std::signal(SIGTERM, handleStopSignal);
+
+    // Первая точка восстановления - полная
+    auto point = backup.createRestorePoint();
+    std::cout << "Создана точка восстановления: " << point->getLocation().string() << std::endl;
+
+    auto deadline = std::chrono::steady_clock::now() + interval;
+    while (!stopRequested) {
+        auto now = std::chrono::steady_clock::now();
+        if (now < deadline) {
+            tracker.poll(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now));
+            continue;
+        }
+        deadline = now + interval;
+
+        if (!tracker.hasChanges()) {
+            continue;
+        }
+
+        std::vector<fs::path> changed;
+        for (auto& path : tracker.takeChanges()) {
+            if (fs::exists(path)) {
+                changed.push_back(std::move(path));
+            } else {
+                std::cerr << "Файл удален, пропускаем: " << path.string() << std::endl;
+            }
+        }
+        if (changed.empty()) {
+            continue;
+        }
+
+        try {
+            point = backup.createRestorePoint(changed);
+            std::cout << "Создана точка восстановления (" << changed.size() << " файлов): "
+                      << point->getLocation().string() << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Ошибка при создании точки восстановления: " << e.what() << std::endl;
+            // Повторим попытку в следующем интервале
+            tracker.markChanged(changed);
+        }
+    }
+
+    std::cout << "Остановка службы резервного копирования" << std::endl;
+    return 0;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     setlocale(LC_ALL, "Russian");
     
     try {
         // Создаем директорию для резервных копий
         fs::path backupDir = fs::current_path() / "backups";
         
-        // Создаем задачу резервного копирования с ZIP-стратегией
-        auto strategy = std::make_unique<ZipStorageStrategy>();
+        // Создаем задачу резервного копирования: с шифрованием, если задан пароль, иначе ZIP
+        std::unique_ptr<IStorageStrategy> strategy;
+        if (const char* passphrase = std::getenv("BACKUP_PASSPHRASE")) {
+            strategy = std::make_unique<EncryptedStorageStrategy>(passphrase);
+        } else {
+            strategy = std::make_unique<ZipStorageStrategy>();
+        }
         BackupJob backup(std::move(strategy), backupDir);
         
         // Устанавливаем callback для отображения прогресса
@@ -28,6 +113,29 @@ int main() {
             std::cout << message << ": " << (progress * 100) << "%" << std::endl;
         });
 
+        if (argc > 1 && std::string(argv[1]) == "--daemon") {
+            long long seconds = 0;
+            if (argc >= 3) {
+                std::istringstream ss(argv[2]);
+                if (!(ss >> seconds) || !ss.eof()) {
+                    seconds = 0;
+                }
+            }
+            if (argc < 4 || seconds <= 0 || seconds > kMaxDaemonIntervalSeconds) {
+                std::cerr << "Использование: " << argv[0]
+                          << " --daemon <интервал_в_секундах> <путь_к_файлу>..." << std::endl;
+                std::cerr << "Интервал - целое число секунд от 1 до " << kMaxDaemonIntervalSeconds << std::endl;
+                return 1;
+            }
+            // inotify сообщает имена относительно наблюдаемой директории,
+            // поэтому пути к файлам делаем абсолютными
+            std::vector<fs::path> paths;
+            for (int i = 3; i < argc; ++i) {
+                paths.push_back(fs::absolute(argv[i]).lexically_normal());
+            }
+            return runDaemon(backup, std::chrono::seconds(seconds), paths);
+        }
+
         std::string command;
         printHelp();
 
@@ -103,6 +211,61 @@ int main() {
                     }
                 }
             }
+            else if (command.substr(0, 6) == "parity") {
+                try {
+                    ParityOptions options;
+                    std::string arguments = command.length() > 7 ? command.substr(7) : "";
+                    std::stringstream ss(arguments);
+                    // Поток молча превращает "-1" в огромное беззнаковое число
+                    if (arguments.find('-') != std::string::npos ||
+                        !(ss >> options.dataShards >> options.parityShards)) {
+                        std::cout << "Использование: parity <фрагменты_данных> <фрагменты_четности>" << std::endl;
+                        continue;
+                    }
+                    backup.setParityOptions(options);
+                    if (options.enabled()) {
+                        std::cout << "Защита четностью: " << options.dataShards << "+"
+                                  << options.parityShards << std::endl;
+                    } else {
+                        std::cout << "Защита четностью отключена" << std::endl;
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Ошибка настройки четности: " << e.what() << std::endl;
+                }
+            }
+            else if (command.substr(0, 5) == "scrub") {
+                try {
+                    auto points = backup.getRestorePoints();
+                    size_t pointIndex;
+                    std::stringstream ss(command.length() > 6 ? command.substr(6) : "");
+                    if (!(ss >> pointIndex) || pointIndex >= points.size()) {
+                        std::cout << "Неверный номер точки восстановления" << std::endl;
+                        continue;
+                    }
+
+                    auto report = backup.scrub(*points[pointIndex]);
+                    std::cout << "Проверено файлов: " << report.filesChecked
+                              << ", полос: " << report.stripesChecked
+                              << ", поврежденных фрагментов: " << report.corruptShards
+                              << ", восстановлено: " << report.repairedShards << std::endl;
+                    if (report.unprotectedFiles > 0) {
+                        std::cout << "Файлов без четности: " << report.unprotectedFiles << std::endl;
+                    }
+                    for (const auto& file : report.damagedFiles) {
+                        std::cerr << "Не удалось восстановить: " << file.string() << std::endl;
+                    }
+                    for (const auto& file : report.damagedParityFiles) {
+                        std::cerr << "Поврежден файл четности: " << file.string() << std::endl;
+                    }
+                    for (const auto& file : report.unsupportedParityFiles) {
+                        std::cerr << "Неподдерживаемая версия файла четности: " << file.string() << std::endl;
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Ошибка при проверке: " << e.what() << std::endl;
+                }
+            }
             else if (command == "help") {
                 printHelp();
             }